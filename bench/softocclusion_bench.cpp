@@ -0,0 +1,91 @@
+// Microbenchmark for IrSoftwareOcclusion: a wall of occluder quads in front of a grid of small boxes, some of
+// which poke out past the wall. Reports rasterized triangles per second and the fraction of meshes culled.
+//
+//   softocclusion_bench [iterations]
+
+#include "irsoftocclusion.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+namespace
+{
+void addBox(std::vector<glm::vec3> &positions, std::vector<uint16_t> &indices, std::vector<IrOcclusionMesh> &meshes,
+            glm::vec3 lo, glm::vec3 hi)
+{
+    static const uint16_t faces[36] = {0, 1, 3, 0, 3, 2, 4, 6, 7, 4, 7, 5, 0, 4, 5, 0, 5, 1,
+                                       2, 3, 7, 2, 7, 6, 0, 2, 6, 0, 6, 4, 1, 5, 7, 1, 7, 3};
+
+    IrOcclusionMesh mesh{};
+    mesh.firstIndex = static_cast<uint32_t>(indices.size());
+    mesh.indexCount = 36;
+    mesh.vertexOffset = static_cast<int32_t>(positions.size());
+    mesh.aabbMin = lo;
+    mesh.aabbMax = hi;
+
+    for (int corner = 0; corner < 8; corner++)
+    {
+        positions.push_back(
+            glm::vec3((corner & 4) ? hi.x : lo.x, (corner & 2) ? hi.y : lo.y, (corner & 1) ? hi.z : lo.z));
+    }
+    indices.insert(indices.end(), faces, faces + 36);
+    meshes.push_back(mesh);
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int iterations = (argc > 1) ? std::atoi(argv[1]) : 1000;
+
+    std::vector<glm::vec3> positions;
+    std::vector<uint16_t> indices;
+    std::vector<IrOcclusionMesh> meshes;
+
+    // Occluders: a 4x3 wall of thick panels at z = 0 covering most of the view.
+    for (int y = 0; y < 3; y++)
+    {
+        for (int x = 0; x < 4; x++)
+        {
+            glm::vec3 lo(-4.0f + 2.0f * x, -3.0f + 2.0f * y, -0.1f);
+            addBox(positions, indices, meshes, lo, lo + glm::vec3(2.0f, 2.0f, 0.2f));
+        }
+    }
+
+    // Occludees: a 32x32 grid of small boxes behind the wall, spread wider than it so the edges stay visible.
+    for (int y = 0; y < 32; y++)
+    {
+        for (int x = 0; x < 32; x++)
+        {
+            glm::vec3 lo(-12.0f + 0.75f * x, -9.0f + 0.5625f * y, -6.0f);
+            addBox(positions, indices, meshes, lo, lo + glm::vec3(0.2f));
+        }
+    }
+
+    glm::mat4 proj = glm::perspective(glm::radians(60.0f), 4.0f / 3.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 6.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 mvp = proj * view;
+
+    IrSoftwareOcclusion occlusion;
+    occlusion.setMeshes(meshes);
+
+    std::vector<uint8_t> visible;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        occlusion.cull(mvp, positions, indices, visible);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    const IrOcclusionStats &stats = occlusion.stats;
+
+    std::printf("lanes:            %d\n", irsimd::width);
+    std::printf("meshes:           %zu\n", meshes.size());
+    std::printf("time per cull:    %.3f us\n", seconds * 1e6 / iterations);
+    std::printf("triangles/s:      %.2f M\n", stats.trianglesRasterized / seconds * 1e-6);
+    std::printf("cull rate:        %.1f %%\n", 100.0 * stats.meshesCulled / std::max<uint64_t>(stats.meshesTested, 1));
+    return 0;
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include "irjobsystem.h"
 #include "render.h"
 
 class Engine
@@ -6,5 +7,6 @@ class Engine
   public:
     Render render;
     ModelLoader modelLoader;
+    IrJobSystem jobSystem; // declared last so its threads are joined before the objects their jobs touch go away
     void run();
 };
\ No newline at end of file
@@ -3,7 +3,9 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
 #include <glm/gtx/hash.hpp>
+#include <cmath>
 #include <stdint.h>
 
 struct Vertex
@@ -14,9 +16,11 @@ struct Vertex
     glm::vec3 color;
     uint32_t flags;
 
+    // Every attribute takes part, so two equal vertices can be welded without changing the shading.
     bool operator==(const Vertex &other) const
     {
-        return pos == other.pos && color == other.color && uv == other.uv;
+        return pos == other.pos && normal == other.normal && uv == other.uv && color == other.color &&
+               flags == other.flags;
     }
 };
 
@@ -24,10 +28,69 @@ namespace std
 {
 template <> struct hash<Vertex>
 {
+    // Folds every float through std::hash (so 0.0f and -0.0f agree, as operator== requires) with a multiply-xorshift
+    // step per value; the plain shift-xor combination clustered badly on grid-aligned CAD coordinates.
     size_t operator()(Vertex const &vertex) const
     {
-        return ((hash<glm::vec3>()(vertex.pos) ^ (hash<glm::vec3>()(vertex.normal) << 1)) >> 1) ^
-               (hash<glm::vec2>()(vertex.uv) << 1) ^ ((hash<glm::vec3>()(vertex.color) >> 1) >> 1);
+        uint64_t h = vertex.flags;
+        const float values[] = {vertex.pos.x,    vertex.pos.y,    vertex.pos.z,   vertex.normal.x,
+                                vertex.normal.y, vertex.normal.z, vertex.uv.x,    vertex.uv.y,
+                                vertex.color.x,  vertex.color.y,  vertex.color.z};
+        for (float value : values)
+        {
+            h = (h ^ hash<float>()(value)) * 0x9E3779B97F4A7C15ull;
+            h ^= h >> 32;
+        }
+        return static_cast<size_t>(h);
     }
 };
 } // namespace std
+
+// One draw's share of a primitive: 16-bit indices starting at firstIndex, relative to vertexOffset. Primitives with
+// more than 65536 vertices are split into several chunks.
+struct IrIndexChunk
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t vertexOffset;
+};
+
+// The vertex as the main pass fetches it, 24 bytes instead of 48. The normal is octahedral-encoded into two snorm16
+// values (R16G16_SNORM, decoded in mesh.vert/mesh_indirect.vert), the uv is two half floats (R16G16_SFLOAT) and the
+// always-white color is dropped. The shadow pass reads the positions from their own tightly packed vec3 stream.
+struct IrPackedVertex
+{
+    glm::vec3 pos;
+    uint32_t normal;
+    uint32_t uv;
+    uint32_t flags;
+};
+
+// Projects the unit sphere onto the octahedron |x| + |y| + |z| = 1 and unfolds its lower half over the corners, so
+// a normal fits in two values in [-1, 1] with nearly uniform precision. The shader inverts this with
+// n = vec3(e, 1 - |e.x| - |e.y|); if (n.z < 0) n.xy = (1 - |n.yx|) * sign(n.xy); normalize(n).
+inline glm::vec2 octahedralEncode(const glm::vec3 &n)
+{
+    float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (l1 == 0.0f)
+    {
+        return glm::vec2(0.0f);
+    }
+    glm::vec2 e = glm::vec2(n.x, n.y) / l1;
+    if (n.z < 0.0f)
+    {
+        glm::vec2 sign(e.x >= 0.0f ? 1.0f : -1.0f, e.y >= 0.0f ? 1.0f : -1.0f);
+        e = (glm::vec2(1.0f) - glm::abs(glm::vec2(e.y, e.x))) * sign;
+    }
+    return e;
+}
+
+inline IrPackedVertex packVertex(const Vertex &vertex)
+{
+    IrPackedVertex packed;
+    packed.pos = vertex.pos;
+    packed.normal = glm::packSnorm2x16(octahedralEncode(vertex.normal));
+    packed.uv = glm::packHalf2x16(vertex.uv);
+    packed.flags = vertex.flags;
+    return packed;
+}
@@ -6,6 +6,7 @@
 #include <stdexcept>
 #include <vector>
 
+#include "iruploadbatch.h"
 #include "resourceManager.h"
 #include "tool.h"
 
@@ -117,7 +118,9 @@ class IrdepthImage : public IrImage
     void createDepth(uint32_t width, uint32_t height)
     {
         VkFormat format = findDepthFormat();
-        createIrImage(width, height, format, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
+        // Sampled by the depth pyramid build when occlusion culling is on.
+        createIrImage(width, height, format, VK_IMAGE_ASPECT_DEPTH_BIT,
+                      VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
     }
 };
 
@@ -125,74 +128,20 @@ class IrTexture : IrImage
 {
   public:
     IrTexture() = default;
-    IrTexture(std::vector<uint8_t> &buffer, size_t width, size_t height)
+    IrTexture(IrUploadBatch &batch, std::vector<uint8_t> &buffer, size_t width, size_t height)
     {
-        createTextureByBuffer(buffer, width, height);
+        createTextureByBuffer(batch, buffer, width, height);
     }
     VkDescriptorImageInfo descriptorSetImageInfo;
-    VkDescriptorSet descriptorSet;
+    // One set per frame in flight, so a slot's set can be repointed while the other slot's frame is still pending.
+    std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> descriptorSets;
 
-    void createTextureImage(std::vector<uint8_t> &buffer, size_t width, size_t height)
+    // pixels holds width * height RGBA8 texels; the copy is recorded into batch and done once it executes.
+    void createTextureImage(IrUploadBatch &batch, const uint8_t *pixels, size_t width, size_t height)
     {
         createIrImage(width, height, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT,
                       VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
-        const VkDeviceSize imageSize = width * height * 4;
-
-        VkBufferCreateInfo stagingBufInfo = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
-        stagingBufInfo.size = imageSize;
-        stagingBufInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-
-        VmaAllocationCreateInfo stagingBufAllocCreateInfo = {};
-        stagingBufAllocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
-        stagingBufAllocCreateInfo.flags =
-            VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
-
-        VkBuffer stagingBuf = VK_NULL_HANDLE;
-        VmaAllocation stagingBufAlloc = VK_NULL_HANDLE;
-        VmaAllocationInfo stagingBufAllocInfo = {};
-        vmaCreateBuffer(allocator, &stagingBufInfo, &stagingBufAllocCreateInfo, &stagingBuf, &stagingBufAlloc,
-                        &stagingBufAllocInfo);
-
-        memcpy(stagingBufAllocInfo.pMappedData, buffer.data(), buffer.size());
-
-        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-        VkImageMemoryBarrier imgMemBarrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
-        imgMemBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        imgMemBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        imgMemBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        imgMemBarrier.subresourceRange.baseMipLevel = 0;
-        imgMemBarrier.subresourceRange.levelCount = 1;
-        imgMemBarrier.subresourceRange.baseArrayLayer = 0;
-        imgMemBarrier.subresourceRange.layerCount = 1;
-        imgMemBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        imgMemBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        imgMemBarrier.image = image;
-        imgMemBarrier.srcAccessMask = 0;
-        imgMemBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
-                             nullptr, 0, nullptr, 1, &imgMemBarrier);
-
-        VkBufferImageCopy region = {};
-        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        region.imageSubresource.layerCount = 1;
-        region.imageExtent.width = width;
-        region.imageExtent.height = height;
-        region.imageExtent.depth = 1;
-
-        vkCmdCopyBufferToImage(commandBuffer, stagingBuf, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-        imgMemBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        imgMemBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imgMemBarrier.image = image;
-        imgMemBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        imgMemBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
-                             nullptr, 0, nullptr, 1, &imgMemBarrier);
-
-        endSingleTimeCommands(commandBuffer);
+        batch.copyToImage(image, pixels, static_cast<uint32_t>(width), static_cast<uint32_t>(height));
     }
 
     void createDescriptorSetImageInfo()
@@ -204,21 +153,33 @@ class IrTexture : IrImage
 
     void createDescriptorSet(std::array<VkDescriptorSetLayout,2>& descriptorSetLayout)
     {
+        std::array<VkDescriptorSetLayout, MAX_FRAMES_IN_FLIGHT> layouts;
+        layouts.fill(descriptorSetLayout[1]);
+
         VkDescriptorSetAllocateInfo allocInfo{};
         allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
         allocInfo.pNext = nullptr;
         allocInfo.descriptorPool = descriptorPool;
-        allocInfo.descriptorSetCount = 1;
-        allocInfo.pSetLayouts = &descriptorSetLayout[1];
+        allocInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
+        allocInfo.pSetLayouts = layouts.data();
 
-        if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS)
+        if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS)
         {
             throw std::runtime_error("create descriptorsets failed");
         }
+        for (uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++)
+        {
+            updateDescriptorSet(frame);
+        }
+    }
+
+    // Points the frame's set at descriptorSetImageInfo again; no pending command buffer may use that set.
+    void updateDescriptorSet(uint32_t frame)
+    {
         VkWriteDescriptorSet writeDescriptorSet{};
 
         writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        writeDescriptorSet.dstSet = descriptorSet;
+        writeDescriptorSet.dstSet = descriptorSets[frame];
         writeDescriptorSet.dstBinding = 0;
         writeDescriptorSet.dstArrayElement = 0;
         writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
@@ -228,9 +189,14 @@ class IrTexture : IrImage
         vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
     }
 
-    void createTextureByBuffer(std::vector<uint8_t> &buffer, size_t width, size_t height)
+    void createTextureByBuffer(IrUploadBatch &batch, std::vector<uint8_t> &buffer, size_t width, size_t height)
+    {
+        createTextureByBuffer(batch, buffer.data(), width, height);
+    }
+
+    void createTextureByBuffer(IrUploadBatch &batch, const uint8_t *pixels, size_t width, size_t height)
     {
-        createTextureImage(buffer, width, height);
+        createTextureImage(batch, pixels, width, height);
         createDescriptorSetImageInfo();
     }
 };
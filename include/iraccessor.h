@@ -0,0 +1,243 @@
+#pragma once
+
+#include "tglfUsage.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+// Set while a memory-mapped .glb is loaded: glTF buffer mappedBuffer is the file's BIN chunk at mappedBufferData
+// and its tinygltf::Buffer holds no data.
+inline int mappedBuffer = -1;
+inline const uint8_t *mappedBufferData = nullptr;
+
+inline const uint8_t *gltfBufferData(const tinygltf::Model &model, int buffer)
+{
+    return (buffer == mappedBuffer) ? mappedBufferData : model.buffers[buffer].data.data();
+}
+
+// Typed, non-owning view of a glTF accessor. Reads go straight to the loaded buffers through the buffer view's
+// byteStride, normalized integer components are converted to float as the glTF spec defines, and sparse
+// substitutions are looked up on the fly, so nothing is ever copied. An accessor without a buffer view reads as
+// zeros (plus its sparse values); a default-constructed view has no elements.
+class IrAccessorView
+{
+  public:
+    size_t count = 0;
+    int componentType = 0;
+    int components = 0;
+    bool normalized = false;
+
+    IrAccessorView() = default;
+
+    IrAccessorView(const tinygltf::Model &model, int accessorIndex)
+    {
+        if (accessorIndex < 0)
+        {
+            return;
+        }
+
+        const tinygltf::Accessor &accessor = model.accessors[accessorIndex];
+        count = accessor.count;
+        componentType = accessor.componentType;
+        components = tinygltf::GetNumComponentsInType(static_cast<uint32_t>(accessor.type));
+        normalized = accessor.normalized;
+        componentSize = tinygltf::GetComponentSizeInBytes(static_cast<uint32_t>(componentType));
+        if (components <= 0 || componentSize <= 0)
+        {
+            throw std::runtime_error("unsupported glTF accessor type.");
+        }
+        stride = static_cast<size_t>(componentSize) * components;
+
+        if (accessor.bufferView >= 0)
+        {
+            const tinygltf::BufferView &view = model.bufferViews[accessor.bufferView];
+            data = gltfBufferData(model, view.buffer) + view.byteOffset + accessor.byteOffset;
+            if (view.byteStride != 0)
+            {
+                stride = view.byteStride;
+            }
+        }
+
+        if (accessor.sparse.isSparse)
+        {
+            const tinygltf::BufferView &indexView = model.bufferViews[accessor.sparse.indices.bufferView];
+            const tinygltf::BufferView &valueView = model.bufferViews[accessor.sparse.values.bufferView];
+            sparseCount = accessor.sparse.count;
+            sparseIndexType = accessor.sparse.indices.componentType;
+            sparseIndices =
+                gltfBufferData(model, indexView.buffer) + indexView.byteOffset + accessor.sparse.indices.byteOffset;
+            sparseValues =
+                gltfBufferData(model, valueView.buffer) + valueView.byteOffset + accessor.sparse.values.byteOffset;
+        }
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+
+    // Component c of element i as a float; missing components read as 0.
+    float readFloat(size_t i, int c) const
+    {
+        const uint8_t *element = elementData(i);
+        if (!element || c >= components)
+        {
+            return 0.0f;
+        }
+        return toFloat(element + static_cast<size_t>(c) * componentSize);
+    }
+
+    template <int N> glm::vec<N, float, glm::defaultp> readVec(size_t i) const
+    {
+        glm::vec<N, float, glm::defaultp> v(0.0f);
+        const uint8_t *element = elementData(i);
+        if (element)
+        {
+            for (int c = 0; c < std::min(N, components); c++)
+            {
+                v[c] = toFloat(element + static_cast<size_t>(c) * componentSize);
+            }
+        }
+        return v;
+    }
+
+    // Elements [first, first + n) split into one array per component: out[c][k] is component c of element first + k.
+    // Plain float data is read without the per-component type dispatch.
+    template <int N> void readComponents(size_t first, size_t n, float *const (&out)[N]) const
+    {
+        if (componentType == TINYGLTF_COMPONENT_TYPE_FLOAT && sparseCount == 0 && data && components >= N)
+        {
+            const uint8_t *element = data + first * stride;
+            for (size_t k = 0; k < n; k++, element += stride)
+            {
+                for (int c = 0; c < N; c++)
+                {
+                    out[c][k] = load<float>(element + c * sizeof(float));
+                }
+            }
+            return;
+        }
+        for (size_t k = 0; k < n; k++)
+        {
+            for (int c = 0; c < N; c++)
+            {
+                out[c][k] = readFloat(first + k, c);
+            }
+        }
+    }
+
+    // Element i of a scalar integer accessor, zero-extended from its component width.
+    uint32_t readIndex(size_t i) const
+    {
+        const uint8_t *element = elementData(i);
+        return element ? readUint(element, componentType) : 0;
+    }
+
+  private:
+    const uint8_t *data = nullptr;
+    size_t stride = 0;
+    int componentSize = 0;
+
+    size_t sparseCount = 0;
+    int sparseIndexType = 0;
+    const uint8_t *sparseIndices = nullptr;
+    const uint8_t *sparseValues = nullptr; // tightly packed, one element per sparse index
+
+    const uint8_t *elementData(size_t i) const
+    {
+        if (sparseCount != 0)
+        {
+            // Sparse indices are strictly increasing, so a binary search finds the substitute if there is one.
+            size_t lo = 0;
+            size_t hi = sparseCount;
+            while (lo < hi)
+            {
+                size_t mid = (lo + hi) / 2;
+                if (sparseIndex(mid) < i)
+                {
+                    lo = mid + 1;
+                }
+                else
+                {
+                    hi = mid;
+                }
+            }
+            if (lo < sparseCount && sparseIndex(lo) == i)
+            {
+                return sparseValues + lo * static_cast<size_t>(componentSize) * components;
+            }
+        }
+        return data ? data + i * stride : nullptr;
+    }
+
+    size_t sparseIndex(size_t k) const
+    {
+        int size = tinygltf::GetComponentSizeInBytes(static_cast<uint32_t>(sparseIndexType));
+        return readUint(sparseIndices + k * size, sparseIndexType);
+    }
+
+    // glTF data is little endian and not necessarily aligned, hence the memcpy.
+    template <typename T> static T load(const uint8_t *p)
+    {
+        T value;
+        std::memcpy(&value, p, sizeof(T));
+        return value;
+    }
+
+    static uint32_t readUint(const uint8_t *p, int type)
+    {
+        switch (type)
+        {
+        case TINYGLTF_COMPONENT_TYPE_BYTE:
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            return load<uint8_t>(p);
+        case TINYGLTF_COMPONENT_TYPE_SHORT:
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+            return load<uint16_t>(p);
+        case TINYGLTF_COMPONENT_TYPE_INT:
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+        case TINYGLTF_COMPONENT_TYPE_FLOAT:
+            return load<uint32_t>(p);
+        default:
+            throw std::runtime_error("Unknown glTF component type.");
+        }
+    }
+
+    float toFloat(const uint8_t *p) const
+    {
+        switch (componentType)
+        {
+        case TINYGLTF_COMPONENT_TYPE_FLOAT:
+            return load<float>(p);
+        case TINYGLTF_COMPONENT_TYPE_BYTE:
+            return normalized ? std::max(load<int8_t>(p) / 127.0f, -1.0f) : load<int8_t>(p);
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            return normalized ? load<uint8_t>(p) / 255.0f : load<uint8_t>(p);
+        case TINYGLTF_COMPONENT_TYPE_SHORT:
+            return normalized ? std::max(load<int16_t>(p) / 32767.0f, -1.0f) : load<int16_t>(p);
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+            return normalized ? load<uint16_t>(p) / 65535.0f : load<uint16_t>(p);
+        case TINYGLTF_COMPONENT_TYPE_INT:
+            return static_cast<float>(load<int32_t>(p));
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+            return static_cast<float>(load<uint32_t>(p));
+        case TINYGLTF_COMPONENT_TYPE_DOUBLE:
+            return static_cast<float>(load<double>(p));
+        default:
+            throw std::runtime_error("Unknown glTF component type.");
+        }
+    }
+};
+
+// The accessor of a primitive attribute, or -1 if the primitive does not have it.
+inline int findAttribute(const tinygltf::Primitive &primitive, const char *name)
+{
+    auto attribute = primitive.attributes.find(name);
+    return (attribute != primitive.attributes.end()) ? attribute->second : -1;
+}
@@ -3,9 +3,12 @@
 #include <GLFW/glfw3.h>
 
 #include "geometry.h"
+#include "iruploadbatch.h"
 #include "tool.h"
 #include <cstdint>
+#include <cstring>
 #include <stdexcept>
+#include <string>
 #include <vector>
 
 #include "VmaUsage.h"
@@ -24,6 +27,8 @@ class IrBuffer
         createIrBuffer(size, usage, flages);
     }
 
+    // With no host access flags VMA places the buffer in device-local memory that is not host visible where the
+    // device has any, which is where static data belongs; host access flags are for data the CPU keeps writing.
     void createIrBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VmaAllocationCreateFlags flages)
     {
         bufferSize = size;
@@ -38,6 +43,34 @@ class IrBuffer
         VmaAllocation alloc;
         vmaCreateBuffer(allocator, &bufCreateInfo, &allocCreateInfo, &buffer, &all, &memHelper);
     }
+
+    // The memory heap the buffer landed in and what kind of memory it is, for logging.
+    std::string memoryPlacement() const
+    {
+        const VkPhysicalDeviceMemoryProperties *memoryProperties;
+        vmaGetMemoryProperties(allocator, &memoryProperties);
+        const VkMemoryType &type = memoryProperties->memoryTypes[memHelper.memoryType];
+
+        std::string placement = "heap " + std::to_string(type.heapIndex);
+        bool deviceLocal = type.propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        bool hostVisible = type.propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        if (deviceLocal && hostVisible)
+        {
+            return placement + " (device local, host visible)";
+        }
+        return placement + (deviceLocal ? " (device local)" : " (host memory)");
+    }
+
+    template <typename T> void uploadData(IrUploadBatch &batch, const std::vector<T> &data)
+    {
+        batch.copyToBuffer(buffer, data.data(), data.size() * sizeof(T));
+    }
+
+    // Records a copy of size bytes to dstOffset into batch; the buffer needs TRANSFER_DST usage.
+    void uploadData(IrUploadBatch &batch, const void *data, VkDeviceSize size, VkDeviceSize dstOffset = 0)
+    {
+        batch.copyToBuffer(buffer, data, size, dstOffset);
+    }
 };
 
 class IrUniformBuffer : public IrBuffer
@@ -49,130 +82,58 @@ class IrUniformBuffer : public IrBuffer
         createIrUniformBuffer(size);
     }
     VkDescriptorBufferInfo descriptorSetBufferInfo;
+    VkDeviceSize sliceSize = 0;
 
-    void createIrUniformBuffer(VkDeviceSize size)
+    // One persistently mapped buffer holding sliceCount copies of the block, one per frame in flight.
+    // Bind with a dynamic offset of slice * sliceSize. Being rewritten every frame, it is the kind of data that
+    // device-local host-visible memory (resizable BAR) is kept for; VMA picks that where the device has it.
+    void createIrUniformBuffer(VkDeviceSize size, uint32_t sliceCount)
     {
-        createIrBuffer(size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                       VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
-                           VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT |
-                           VMA_ALLOCATION_CREATE_MAPPED_BIT);
-        setDescriptorSetBufferInfo();
-    }
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        VkDeviceSize alignment = properties.limits.minUniformBufferOffsetAlignment;
+        sliceSize = (size + alignment - 1) & ~(alignment - 1);
+
+        createIrBuffer(sliceSize * sliceCount, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                       VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT);
 
-    void setDescriptorSetBufferInfo()
-    {
         descriptorSetBufferInfo.buffer = buffer;
         descriptorSetBufferInfo.offset = 0;
-        descriptorSetBufferInfo.range = VK_WHOLE_SIZE;
+        descriptorSetBufferInfo.range = size;
     }
 
-    template <typename T>
-
-    void copytoUniformBuffer(T ubo)
+    uint32_t sliceOffset(uint32_t slice)
     {
-        createIrUniformBuffer(sizeof(ubo));
-
-        VkMemoryPropertyFlags memPropFlags;
-        vmaGetAllocationMemoryProperties(allocator, all, &memPropFlags);
-
-        if (memPropFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
-        {
-            memcpy(memHelper.pMappedData, &ubo, sizeof(ubo));
-            vmaFlushAllocation(allocator, all, 0, VK_WHOLE_SIZE);
-            // Check result...
-
-            VkBufferMemoryBarrier bufMemBarrier = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
-            bufMemBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-            bufMemBarrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
-            bufMemBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            bufMemBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            bufMemBarrier.buffer = buffer;
-            bufMemBarrier.offset = 0;
-            bufMemBarrier.size = VK_WHOLE_SIZE;
-
-            VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 0,
-                                 nullptr, 1, &bufMemBarrier, 0, nullptr);
-            endSingleTimeCommands(commandBuffer);
-        }
-        else
-        {
-            IrBuffer stagingBuffer;
-            stagingBuffer.createIrBuffer(sizeof(ubo), VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                         VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
-                                             VMA_ALLOCATION_CREATE_MAPPED_BIT);
-
-            memcpy(stagingBuffer.memHelper.pMappedData, &ubo, sizeof(ubo));
-            vmaFlushAllocation(allocator, stagingBuffer.all, 0, VK_WHOLE_SIZE);
-
-            VkBufferMemoryBarrier bufMemBarrier = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
-            bufMemBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-            bufMemBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-            bufMemBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            bufMemBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            bufMemBarrier.buffer = stagingBuffer.buffer;
-            bufMemBarrier.offset = 0;
-            bufMemBarrier.size = VK_WHOLE_SIZE;
-            VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
-                                 nullptr, 1, &bufMemBarrier, 0, nullptr);
-
-            VkBufferCopy bufCopy = {
-                0,           // srcOffset
-                0,           // dstOffset,
-                sizeof(ubo), // size
-            };
-
-            vkCmdCopyBuffer(commandBuffer, stagingBuffer.buffer, buffer, 1, &bufCopy);
-
-            VkBufferMemoryBarrier bufMemBarrier2 = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
-            bufMemBarrier2.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            bufMemBarrier2.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT; // We created a uniform buffer
-            bufMemBarrier2.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            bufMemBarrier2.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            bufMemBarrier2.buffer = buffer;
-            bufMemBarrier2.offset = 0;
-            bufMemBarrier2.size = VK_WHOLE_SIZE;
-
-            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0,
-                                 0, nullptr, 1, &bufMemBarrier2, 0, nullptr);
-            endSingleTimeCommands(commandBuffer);
-        }
+        return static_cast<uint32_t>(slice * sliceSize);
     }
-};
 
-class IrStageBuffer : public IrBuffer
-{
-  public:
-    IrStageBuffer() = default;
-    IrStageBuffer(VkDeviceSize size)
+    template <typename T> void copytoSlice(uint32_t slice, const T &ubo)
     {
-        createIrStageBuffer(size);
-    }
-    void createIrStageBuffer(VkDeviceSize size)
-    {
-        createIrBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                       VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT);
+        memcpy(static_cast<char *>(memHelper.pMappedData) + sliceOffset(slice), &ubo, sizeof(ubo));
+        vmaFlushAllocation(allocator, all, sliceOffset(slice), sizeof(ubo));
     }
-    template <typename T>
 
-    void loadData(std::vector<T> data)
+    // A block written once, such as the offscreen uniform: device-local like the static geometry, so it stays out
+    // of the host-visible device memory kept for the per-frame slices, and filled through the staging ring.
+    void createIrUniformBuffer(VkDeviceSize size)
     {
-        memcpy(memHelper.pMappedData, data.data(), data.size() * sizeof(T));
+        createIrBuffer(size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 0);
+        setDescriptorSetBufferInfo();
     }
 
-    void tobuffer(IrBuffer &dstbuffer)
+    void setDescriptorSetBufferInfo()
     {
-        VkCommandBuffer command = beginSingleTimeCommands();
+        descriptorSetBufferInfo.buffer = buffer;
+        descriptorSetBufferInfo.offset = 0;
+        descriptorSetBufferInfo.range = VK_WHOLE_SIZE;
+    }
 
-        VkBufferCopy copyRegion = {};
-        copyRegion.srcOffset = 0;
-        copyRegion.dstOffset = 0;
-        copyRegion.size = bufferSize;
-        vkCmdCopyBuffer(command, buffer, dstbuffer.buffer, 1, &copyRegion);
+    template <typename T>
 
-        endSingleTimeCommands(command);
+    void copytoUniformBuffer(IrUploadBatch &batch, T ubo)
+    {
+        createIrUniformBuffer(sizeof(ubo));
+        // The batch makes the copy visible to uniform reads on the graphics queue once it is submitted.
+        batch.copyToBuffer(buffer, &ubo, sizeof(ubo));
     }
 };
@@ -0,0 +1,275 @@
+#pragma once
+#include <stdint.h>
+#define GLFW_INCLUDE_VULKAN
+#include "irbuffer.h"
+#include "irdescriptor.h"
+#include "irdepthpyramid.h"
+#include "irdrawlist.h"
+#include "irmeshlet.h"
+#include "irpipeline.h"
+#include <GLFW/glfw3.h>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_access.hpp>
+
+#include <array>
+
+struct UniformCull
+{
+    alignas(16) glm::vec4 cameraPlanes[6];
+    alignas(16) glm::vec4 lightPlanes[6];
+    alignas(16) glm::mat4 cameraModelView;
+    alignas(16) glm::vec4 projection; // P00, P11, znear, unused
+    alignas(16) glm::vec2 pyramidSize;
+    uint32_t shadowCount;
+    uint32_t mainCount;
+    uint32_t meshletCount;
+    alignas(16) glm::vec4 cameraPosition; // in model space, the apex side of the meshlet cone test
+};
+
+// Frustum culling on the GPU. cull.comp runs one invocation per candidate command in IrIndirectDraws: the first
+// shadowCount are tested against lightPlanes, the rest against cameraPlanes, using bounds[command.firstInstance].
+// Survivors are appended to the pass's region of the frame's draw buffer and counted with atomicAdd in
+// counts[0] (shadow) and counts[1] (main), which vkCmdDrawIndexedIndirectCount then consumes. Its maxDrawCount is
+// clamped to the device's maxDrawIndirectCount, which is at least 2^16 - 1 with multiDrawIndirect.
+//
+// With occlusion culling, cull_occlusion.comp runs in two phases around the depth pyramid build:
+//  - phase 0 does the above, but only keeps main draws whose visibility[slot] was set last frame (early pass);
+//  - phase 1 runs one invocation per main candidate after the early pass depth has been reduced. It projects the
+//    bounding sphere with cameraModelView and projection, samples the pyramid level where the screen rect
+//    covers at most 2x2 texels, and stores the result in visibility[slot]. Draws that pass now but were not
+//    drawn early are the disoccluded ones; they go to the late region, counted in counts[2].
+//
+// With cluster culling the early (or only) main pass draws meshlets instead: cluster_cull.comp runs alongside
+// the draw cull and appends one command per surviving meshlet to clusterDrawBuffers, counted in counts[3]. Every
+// command keeps its draw's slot as firstInstance, so materials resolve as before. The shadow pass and the late
+// pass still work on whole draws.
+class IrCullPass
+{
+  public:
+    IrCullPipeline pipeline;
+    IrClusterCullPipeline clusterPipeline;
+    IrCullDescriptor cullDescriptor;
+    IrUniformBuffer uniformCull;
+    UniformCull ucull;
+    IrBuffer boundsBuffer;
+    IrBuffer visibilityBuffer;
+    IrBuffer meshletBuffer;
+    std::array<IrBuffer, MAX_FRAMES_IN_FLIGHT> drawBuffers;
+    std::array<IrBuffer, MAX_FRAMES_IN_FLIGHT> clusterDrawBuffers;
+    std::array<IrBuffer, MAX_FRAMES_IN_FLIGHT> countBuffers;
+    IrIndirectRange shadowRange{};
+    IrIndirectRange mainRange{};
+    uint32_t meshletCount = 0;
+
+    bool occlusion = false;
+    bool clusters = false;
+
+    static const uint32_t workgroupSize = 64;
+
+    void createCullPass(IrUploadBatch &batch, IrDrawList &drawList, IrIndirectDraws &indirectDraws,
+                        IrDepthPyramid *depthPyramid = nullptr, const std::vector<IrMeshlet> *meshlets = nullptr)
+    {
+        occlusion = depthPyramid != nullptr;
+        clusters = meshlets != nullptr;
+        meshletCount = clusters ? static_cast<uint32_t>(meshlets->size()) : 0;
+        shadowRange = indirectDraws.shadowRange;
+        mainRange = indirectDraws.mainRange;
+
+        std::vector<IrDrawBounds> bounds = drawList.bounds;
+        if (bounds.empty())
+        {
+            bounds.push_back({});
+        }
+        indirectDraws.uploadBuffer(batch, boundsBuffer, bounds, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+        if (occlusion)
+        {
+            // Everything starts visible, so the first frame draws all of it early and the late pass adds nothing.
+            std::vector<uint32_t> visibility(std::max<size_t>(drawList.items.size(), 1), 1);
+            indirectDraws.uploadBuffer(batch, visibilityBuffer, visibility, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+            setPyramidSize(*depthPyramid);
+        }
+
+        if (clusters)
+        {
+            std::vector<IrMeshlet> clusterList = *meshlets;
+            if (clusterList.empty())
+            {
+                clusterList.push_back({});
+            }
+            indirectDraws.uploadBuffer(batch, meshletBuffer, clusterList, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        }
+
+        uniformCull.createIrUniformBuffer(sizeof(UniformCull), MAX_FRAMES_IN_FLIGHT);
+
+        uint32_t regionCommands = shadowRange.count + mainRange.count * (occlusion ? 2 : 1);
+        VkDeviceSize drawBufferSize =
+            std::max<VkDeviceSize>(regionCommands, 1) * sizeof(VkDrawIndexedIndirectCommand);
+
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            drawBuffers[i].createIrBuffer(drawBufferSize,
+                                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, 0);
+            countBuffers[i].createIrBuffer(4 * sizeof(uint32_t),
+                                           VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                               VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                           0);
+
+            std::vector<VkDescriptorBufferInfo> bufferInfos;
+            bufferInfos.push_back({uniformCull.buffer, uniformCull.sliceOffset(i), sizeof(UniformCull)});
+            bufferInfos.push_back({boundsBuffer.buffer, 0, VK_WHOLE_SIZE});
+            bufferInfos.push_back({indirectDraws.indirectBuffer.buffer, 0, VK_WHOLE_SIZE});
+            bufferInfos.push_back({drawBuffers[i].buffer, 0, VK_WHOLE_SIZE});
+            bufferInfos.push_back({countBuffers[i].buffer, 0, VK_WHOLE_SIZE});
+            if (occlusion)
+            {
+                bufferInfos.push_back({visibilityBuffer.buffer, 0, VK_WHOLE_SIZE});
+            }
+            if (clusters)
+            {
+                clusterDrawBuffers[i].createIrBuffer(std::max<VkDeviceSize>(meshletCount, 1) *
+                                                         sizeof(VkDrawIndexedIndirectCommand),
+                                                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                         VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                                                     0);
+                bufferInfos.push_back({meshletBuffer.buffer, 0, VK_WHOLE_SIZE});
+                bufferInfos.push_back({clusterDrawBuffers[i].buffer, 0, VK_WHOLE_SIZE});
+            }
+            cullDescriptor.createCullDescriptorSet(i, bufferInfos,
+                                                   occlusion ? &depthPyramid->descriptorImageInfo : nullptr);
+        }
+    }
+
+    // Called after the pyramid is recreated for a new swap chain extent.
+    void updatePyramid(IrDepthPyramid &depthPyramid)
+    {
+        setPyramidSize(depthPyramid);
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            cullDescriptor.updatePyramid(i, depthPyramid.descriptorImageInfo);
+        }
+    }
+
+    void updateFrustums(uint32_t frame, const glm::mat4 &cameraModelView, const glm::mat4 &cameraProj,
+                        const glm::mat4 &lightMVP)
+    {
+        extractPlanes(cameraProj * cameraModelView, ucull.cameraPlanes);
+        extractPlanes(lightMVP, ucull.lightPlanes);
+        ucull.cameraModelView = cameraModelView;
+        // For a [0, 1] depth perspective projection proj[3][2] / proj[2][2] is the near plane distance.
+        ucull.projection = glm::vec4(cameraProj[0][0], cameraProj[1][1], cameraProj[3][2] / cameraProj[2][2], 0.0f);
+        ucull.shadowCount = shadowRange.count;
+        ucull.mainCount = mainRange.count;
+        ucull.meshletCount = meshletCount;
+        ucull.cameraPosition = glm::inverse(cameraModelView)[3];
+        uniformCull.copytoSlice(frame, ucull);
+    }
+
+    // Must be recorded outside a render pass, before either pass draws from this frame's buffers.
+    void recordCull(VkCommandBuffer commandBuffer, uint32_t frame)
+    {
+        uint32_t candidates = shadowRange.count + mainRange.count;
+
+        vkCmdFillBuffer(commandBuffer, countBuffers[frame].buffer, 0, VK_WHOLE_SIZE, 0);
+
+        VkMemoryBarrier clearBarrier = {VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+        clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                             &clearBarrier, 0, nullptr, 0, nullptr);
+
+        dispatch(commandBuffer, frame, 0, candidates);
+    }
+
+    // Phase 1 of occlusion culling: must be recorded after the depth pyramid build and before the late pass.
+    void recordLateCull(VkCommandBuffer commandBuffer, uint32_t frame)
+    {
+        dispatch(commandBuffer, frame, 1, mainRange.count);
+    }
+
+    void draw(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t passMask)
+    {
+        bool shadow = passMask & IR_PASS_SHADOW;
+        if (!shadow && clusters)
+        {
+            vkCmdDrawIndexedIndirectCount(commandBuffer, clusterDrawBuffers[frame].buffer, 0,
+                                          countBuffers[frame].buffer, 3 * sizeof(uint32_t),
+                                          std::min(meshletCount, maxDrawIndirectCount),
+                                          sizeof(VkDrawIndexedIndirectCommand));
+            return;
+        }
+        const IrIndirectRange &range = shadow ? shadowRange : mainRange;
+        vkCmdDrawIndexedIndirectCount(commandBuffer, drawBuffers[frame].buffer, range.offset,
+                                      countBuffers[frame].buffer, shadow ? 0 : sizeof(uint32_t),
+                                      std::min(range.count, maxDrawIndirectCount),
+                                      sizeof(VkDrawIndexedIndirectCommand));
+    }
+
+    // The disoccluded main draws found by recordLateCull.
+    void drawLate(VkCommandBuffer commandBuffer, uint32_t frame)
+    {
+        VkDeviceSize offset = mainRange.offset + mainRange.count * sizeof(VkDrawIndexedIndirectCommand);
+        vkCmdDrawIndexedIndirectCount(commandBuffer, drawBuffers[frame].buffer, offset, countBuffers[frame].buffer,
+                                      2 * sizeof(uint32_t), std::min(mainRange.count, maxDrawIndirectCount),
+                                      sizeof(VkDrawIndexedIndirectCommand));
+    }
+
+  private:
+    void dispatch(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t phase, uint32_t invocations)
+    {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.computePipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.pipelineLayout, 0, 1,
+                                &cullDescriptor.cullDescriptorSets[frame], 0, nullptr);
+        if (occlusion)
+        {
+            vkCmdPushConstants(commandBuffer, pipeline.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                               sizeof(uint32_t), &phase);
+        }
+        vkCmdDispatch(commandBuffer, (invocations + workgroupSize - 1) / workgroupSize, 1, 1);
+
+        // The meshlet cull writes nothing the draw cull reads, so both share the barrier below.
+        if (phase == 0 && clusters)
+        {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, clusterPipeline.computePipeline);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, clusterPipeline.pipelineLayout, 0,
+                                    1, &cullDescriptor.cullDescriptorSets[frame], 0, nullptr);
+            vkCmdDispatch(commandBuffer, (meshletCount + workgroupSize - 1) / workgroupSize, 1, 1);
+        }
+
+        VkMemoryBarrier cullBarrier = {VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+        cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                             &cullBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    void setPyramidSize(IrDepthPyramid &depthPyramid)
+    {
+        ucull.pyramidSize = glm::vec2(depthPyramid.width, depthPyramid.height);
+    }
+
+    // Gribb/Hartmann plane extraction for a [0, 1] depth range; planes point inwards and are normalized.
+    static void extractPlanes(const glm::mat4 &m, glm::vec4 (&planes)[6])
+    {
+        glm::vec4 r0 = glm::row(m, 0);
+        glm::vec4 r1 = glm::row(m, 1);
+        glm::vec4 r2 = glm::row(m, 2);
+        glm::vec4 r3 = glm::row(m, 3);
+
+        planes[0] = r3 + r0;
+        planes[1] = r3 - r0;
+        planes[2] = r3 + r1;
+        planes[3] = r3 - r1;
+        planes[4] = r2;
+        planes[5] = r3 - r2;
+
+        for (glm::vec4 &plane : planes)
+        {
+            plane /= glm::length(glm::vec3(plane));
+        }
+    }
+};
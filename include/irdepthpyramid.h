@@ -0,0 +1,188 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "irImage.h"
+#include "irdescriptor.h"
+#include "irpipeline.h"
+#include "resourceManager.h"
+#include "tool.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+
+// Hierarchical-Z pyramid of the main pass depth buffer. Level 0 is the largest power of two that fits the swap
+// chain, and every texel holds the farthest depth of the texels it covers (a max-reduction sampler does the 2x2
+// reduce, and also covers the odd sizes left when a level is not an exact halving). The image stays in
+// VK_IMAGE_LAYOUT_GENERAL so it can be written as a storage image and sampled by the cull pass.
+class IrDepthPyramid : public IrImage
+{
+  public:
+    IrDepthReduceDescriptor depthReduceDescriptor;
+    IrDepthReducePipeline pipeline;
+    VkSampler reduceSampler;
+    VkDescriptorImageInfo descriptorImageInfo;
+    std::array<VkImageView, maxDepthPyramidLevels> levelViews{};
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t levels = 0;
+
+    static const uint32_t workgroupSize = 8;
+
+    // Only valid when createLogicalDevice kept occlusionCulling: it checks that both the depth format and
+    // R32_SFLOAT support min/max filtering.
+    void createReduceSampler()
+    {
+        VkSamplerReductionModeCreateInfo reductionInfo{};
+        reductionInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_REDUCTION_MODE_CREATE_INFO;
+        reductionInfo.reductionMode = VK_SAMPLER_REDUCTION_MODE_MAX;
+
+        VkSamplerCreateInfo samplerInfo = {VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+        samplerInfo.pNext = &reductionInfo;
+        samplerInfo.magFilter = VK_FILTER_LINEAR;
+        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.minLod = 0.f;
+        samplerInfo.maxLod = static_cast<float>(maxDepthPyramidLevels);
+
+        if (vkCreateSampler(device, &samplerInfo, nullptr, &reduceSampler) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create depth pyramid sampler!");
+        }
+    }
+
+    void createDepthPyramid(IrdepthImage &depthImage, VkExtent2D extent)
+    {
+        width = previousPow2(extent.width);
+        height = previousPow2(extent.height);
+        levels = 1;
+        while (levels < maxDepthPyramidLevels && (std::max(width, height) >> levels) > 0)
+        {
+            levels++;
+        }
+
+        createImage(width, height, VK_FORMAT_R32_SFLOAT, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_TILING_OPTIMAL,
+                    VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, levels);
+        imageView = createLevelView(0, levels);
+        for (uint32_t level = 0; level < levels; level++)
+        {
+            levelViews[level] = createLevelView(level, 1);
+        }
+
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, levels, 0, 1};
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0, 0, nullptr, 0, nullptr, 1, &barrier);
+        endSingleTimeCommands(commandBuffer);
+
+        descriptorImageInfo.sampler = reduceSampler;
+        descriptorImageInfo.imageView = imageView;
+        descriptorImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        for (uint32_t level = 0; level < levels; level++)
+        {
+            VkDescriptorImageInfo srcInfo{};
+            srcInfo.sampler = reduceSampler;
+            srcInfo.imageView = (level == 0) ? depthImage.imageView : levelViews[level - 1];
+            srcInfo.imageLayout =
+                (level == 0) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+            VkDescriptorImageInfo dstInfo{};
+            dstInfo.imageView = levelViews[level];
+            dstInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            depthReduceDescriptor.createDepthReduceDescriptorSet(level, srcInfo, dstInfo);
+        }
+    }
+
+    void destroyDepthPyramid()
+    {
+        for (uint32_t level = 0; level < levels; level++)
+        {
+            vkDestroyImageView(device, levelViews[level], nullptr);
+        }
+        irDestroyImage();
+        levels = 0;
+    }
+
+    // Expects the depth buffer in DEPTH_STENCIL_READ_ONLY_OPTIMAL with its writes made visible to compute, as
+    // the early render pass leaves it. Leaves every level readable by the compute stage.
+    void recordBuild(VkCommandBuffer commandBuffer)
+    {
+        // The previous frame's late cull may still be sampling the pyramid.
+        VkMemoryBarrier readBarrier = {VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+        readBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        readBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0, 1, &readBarrier, 0, nullptr, 0, nullptr);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.computePipeline);
+
+        for (uint32_t level = 0; level < levels; level++)
+        {
+            uint32_t levelWidth = std::max(width >> level, 1u);
+            uint32_t levelHeight = std::max(height >> level, 1u);
+            glm::vec2 levelSize(levelWidth, levelHeight);
+
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.pipelineLayout, 0, 1,
+                                    &depthReduceDescriptor.depthReduceDescriptorSets[level], 0, nullptr);
+            vkCmdPushConstants(commandBuffer, pipeline.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                               sizeof(glm::vec2), &levelSize);
+            vkCmdDispatch(commandBuffer, (levelWidth + workgroupSize - 1) / workgroupSize,
+                          (levelHeight + workgroupSize - 1) / workgroupSize, 1);
+
+            VkMemoryBarrier levelBarrier = {VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+            levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &levelBarrier, 0, nullptr, 0, nullptr);
+        }
+    }
+
+  private:
+    VkImageView createLevelView(uint32_t baseLevel, uint32_t levelCount)
+    {
+        VkImageViewCreateInfo imageViewInfo = {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+        imageViewInfo.image = image;
+        imageViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        imageViewInfo.format = VK_FORMAT_R32_SFLOAT;
+        imageViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        imageViewInfo.subresourceRange.baseMipLevel = baseLevel;
+        imageViewInfo.subresourceRange.levelCount = levelCount;
+        imageViewInfo.subresourceRange.baseArrayLayer = 0;
+        imageViewInfo.subresourceRange.layerCount = 1;
+
+        VkImageView view;
+        if (vkCreateImageView(device, &imageViewInfo, nullptr, &view) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create image view!");
+        }
+        return view;
+    }
+
+    static uint32_t previousPow2(uint32_t v)
+    {
+        uint32_t r = 1;
+        while (r * 2 <= v)
+        {
+            r *= 2;
+        }
+        return r;
+    }
+};
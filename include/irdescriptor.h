@@ -1,6 +1,7 @@
 #pragma once
 
 #include "irImage.h"
+#include <algorithm>
 #include <array>
 #include <vector>
 
@@ -17,7 +18,7 @@ class IrShadowRenderDescriptor
         VkDescriptorSetLayoutBinding uniformLayoutBinding{};
         uniformLayoutBinding.binding = 0;
         uniformLayoutBinding.descriptorCount = 1;
-        uniformLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        uniformLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
         uniformLayoutBinding.pImmutableSamplers = nullptr;
         uniformLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
@@ -83,7 +84,7 @@ class IrShadowRenderDescriptor
         uniformWriteDescriptorSet.dstSet = shadowRenderDescriptorSet;
         uniformWriteDescriptorSet.dstBinding = 0;
         uniformWriteDescriptorSet.dstArrayElement = 0;
-        uniformWriteDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        uniformWriteDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
         uniformWriteDescriptorSet.descriptorCount = 1;
         uniformWriteDescriptorSet.pBufferInfo = &uniformBufferInfo;
 
@@ -174,7 +175,7 @@ class IrDebugDescriptor
         VkDescriptorSetLayoutBinding uniformLayoutBinding{};
         uniformLayoutBinding.binding = 0;
         uniformLayoutBinding.descriptorCount = 1;
-        uniformLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        uniformLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
         uniformLayoutBinding.pImmutableSamplers = nullptr;
         uniformLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
@@ -220,7 +221,7 @@ class IrDebugDescriptor
         uniformWriteDescriptorSet.dstSet = debugDescriptorSet;
         uniformWriteDescriptorSet.dstBinding = 0;
         uniformWriteDescriptorSet.dstArrayElement = 0;
-        uniformWriteDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        uniformWriteDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
         uniformWriteDescriptorSet.descriptorCount = 1;
         uniformWriteDescriptorSet.pBufferInfo = &uniformBufferInfo;
 
@@ -240,3 +241,309 @@ class IrDebugDescriptor
         vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, nullptr);
     }
 };
+
+// Set 1 of the indirect main pass: every texture in one array plus the per-draw material SSBO.
+class IrIndirectDescriptor
+{
+  public:
+    VkDescriptorSetLayout indirectDescriptorSetLayout;
+    std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> indirectDescriptorSets; // per frame in flight, as IrTexture
+    uint32_t textureCount;
+
+    void createIndirectDescriptorSetLayouts(uint32_t count)
+    {
+        textureCount = count;
+
+        VkDescriptorSetLayoutBinding texturesLayoutBinding{};
+        texturesLayoutBinding.binding = 0;
+        texturesLayoutBinding.descriptorCount = std::max(textureCount, 1u);
+        texturesLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        texturesLayoutBinding.pImmutableSamplers = nullptr;
+        texturesLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        VkDescriptorSetLayoutBinding materialLayoutBinding{};
+        materialLayoutBinding.binding = 1;
+        materialLayoutBinding.descriptorCount = 1;
+        materialLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        materialLayoutBinding.pImmutableSamplers = nullptr;
+        materialLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        std::array<VkDescriptorSetLayoutBinding, 2> Bindings = {texturesLayoutBinding, materialLayoutBinding};
+
+        VkDescriptorSetLayoutCreateInfo createLayoutInfo{};
+
+        createLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        createLayoutInfo.bindingCount = Bindings.size();
+        createLayoutInfo.pBindings = Bindings.data();
+
+        if (vkCreateDescriptorSetLayout(device, &createLayoutInfo, nullptr, &indirectDescriptorSetLayout) !=
+            VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create descriptor set layout!");
+        }
+    }
+
+    // textureImageInfos fills the whole texture array, so it must hold max(textureCount, 1) entries: pass a
+    // placeholder for scenes without textures.
+    void createIndirectDescriptorSet(std::vector<VkDescriptorImageInfo> &textureImageInfos,
+                                     VkDescriptorBufferInfo &materialBufferInfo)
+    {
+        std::array<VkDescriptorSetLayout, MAX_FRAMES_IN_FLIGHT> layouts;
+        layouts.fill(indirectDescriptorSetLayout);
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.pNext = nullptr;
+        allocInfo.descriptorPool = descriptorPool;
+        allocInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
+        allocInfo.pSetLayouts = layouts.data();
+
+        if (vkAllocateDescriptorSets(device, &allocInfo, indirectDescriptorSets.data()) != VK_SUCCESS)
+        {
+            throw std::runtime_error("create descriptorsets failed");
+        }
+
+        std::vector<VkWriteDescriptorSet> writeDescriptorSets;
+
+        for (VkDescriptorSet descriptorSet : indirectDescriptorSets)
+        {
+            VkWriteDescriptorSet texturesWriteDescriptorSet{};
+            texturesWriteDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            texturesWriteDescriptorSet.dstSet = descriptorSet;
+            texturesWriteDescriptorSet.dstBinding = 0;
+            texturesWriteDescriptorSet.dstArrayElement = 0;
+            texturesWriteDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            texturesWriteDescriptorSet.descriptorCount = static_cast<uint32_t>(textureImageInfos.size());
+            texturesWriteDescriptorSet.pImageInfo = textureImageInfos.data();
+
+            writeDescriptorSets.push_back(texturesWriteDescriptorSet);
+
+            VkWriteDescriptorSet materialWriteDescriptorSet{};
+            materialWriteDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            materialWriteDescriptorSet.dstSet = descriptorSet;
+            materialWriteDescriptorSet.dstBinding = 1;
+            materialWriteDescriptorSet.dstArrayElement = 0;
+            materialWriteDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            materialWriteDescriptorSet.descriptorCount = 1;
+            materialWriteDescriptorSet.pBufferInfo = &materialBufferInfo;
+
+            writeDescriptorSets.push_back(materialWriteDescriptorSet);
+        }
+
+        vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, nullptr);
+    }
+
+    // Rewrites the texture array elements [first, first + count) of the frame's set from textureImageInfos, e.g.
+    // when streamed textures replace the placeholder. No pending command buffer may use that set.
+    void updateIndirectTextures(uint32_t frame, const std::vector<VkDescriptorImageInfo> &textureImageInfos,
+                                uint32_t first, uint32_t count)
+    {
+        VkWriteDescriptorSet texturesWriteDescriptorSet{};
+        texturesWriteDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        texturesWriteDescriptorSet.dstSet = indirectDescriptorSets[frame];
+        texturesWriteDescriptorSet.dstBinding = 0;
+        texturesWriteDescriptorSet.dstArrayElement = first;
+        texturesWriteDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        texturesWriteDescriptorSet.descriptorCount = count;
+        texturesWriteDescriptorSet.pImageInfo = textureImageInfos.data() + first;
+
+        vkUpdateDescriptorSets(device, 1, &texturesWriteDescriptorSet, 0, nullptr);
+    }
+};
+
+// Compute culling: frustum uniform, draw bounds, source commands, compacted commands and per-pass counts.
+class IrCullDescriptor
+{
+  public:
+    VkDescriptorSetLayout cullDescriptorSetLayout;
+    std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> cullDescriptorSets;
+    std::vector<uint32_t> bindings; // in use, ascending
+
+    // Bindings 0-4 are the frustum cull inputs and outputs. With occlusion culling, binding 5 is the per-draw
+    // visibility buffer and binding 6 the depth pyramid. With cluster culling, binding 7 holds the meshlets and
+    // binding 8 receives the commands of the surviving ones.
+    void createCullDescriptorSetLayouts(bool occlusion, bool clusters)
+    {
+        bindings = {0, 1, 2, 3, 4};
+        if (occlusion)
+        {
+            bindings.insert(bindings.end(), {5, 6});
+        }
+        if (clusters)
+        {
+            bindings.insert(bindings.end(), {7, 8});
+        }
+
+        std::vector<VkDescriptorSetLayoutBinding> Bindings(bindings.size());
+        for (uint32_t i = 0; i < Bindings.size(); i++)
+        {
+            Bindings[i].binding = bindings[i];
+            Bindings[i].descriptorCount = 1;
+            Bindings[i].descriptorType = bindingType(bindings[i]);
+            Bindings[i].pImmutableSamplers = nullptr;
+            Bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo createLayoutInfo{};
+
+        createLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        createLayoutInfo.bindingCount = Bindings.size();
+        createLayoutInfo.pBindings = Bindings.data();
+
+        if (vkCreateDescriptorSetLayout(device, &createLayoutInfo, nullptr, &cullDescriptorSetLayout) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create descriptor set layout!");
+        }
+    }
+
+    // bufferInfos holds the buffer bindings in order for one frame in flight; pyramidInfo is only given with
+    // occlusion culling.
+    void createCullDescriptorSet(uint32_t frame, const std::vector<VkDescriptorBufferInfo> &bufferInfos,
+                                 const VkDescriptorImageInfo *pyramidInfo = nullptr)
+    {
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.pNext = nullptr;
+        allocInfo.descriptorPool = descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &cullDescriptorSetLayout;
+
+        if (vkAllocateDescriptorSets(device, &allocInfo, &cullDescriptorSets[frame]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("create descriptorsets failed");
+        }
+
+        std::vector<VkWriteDescriptorSet> writeDescriptorSets;
+
+        uint32_t next = 0;
+        for (uint32_t binding : bindings)
+        {
+            if (binding == 6)
+            {
+                continue; // the pyramid, written by updatePyramid
+            }
+
+            VkWriteDescriptorSet writeDescriptorSet{};
+            writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writeDescriptorSet.dstSet = cullDescriptorSets[frame];
+            writeDescriptorSet.dstBinding = binding;
+            writeDescriptorSet.dstArrayElement = 0;
+            writeDescriptorSet.descriptorType = bindingType(binding);
+            writeDescriptorSet.descriptorCount = 1;
+            writeDescriptorSet.pBufferInfo = &bufferInfos[next++];
+
+            writeDescriptorSets.push_back(writeDescriptorSet);
+        }
+
+        vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, nullptr);
+
+        if (pyramidInfo != nullptr)
+        {
+            updatePyramid(frame, *pyramidInfo);
+        }
+    }
+
+    // The pyramid is recreated with the swap chain, so its binding is rewritten separately.
+    void updatePyramid(uint32_t frame, const VkDescriptorImageInfo &pyramidInfo)
+    {
+        VkWriteDescriptorSet writeDescriptorSet{};
+        writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeDescriptorSet.dstSet = cullDescriptorSets[frame];
+        writeDescriptorSet.dstBinding = 6;
+        writeDescriptorSet.dstArrayElement = 0;
+        writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writeDescriptorSet.descriptorCount = 1;
+        writeDescriptorSet.pImageInfo = &pyramidInfo;
+
+        vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+    }
+
+  private:
+    static VkDescriptorType bindingType(uint32_t binding)
+    {
+        if (binding == 0)
+        {
+            return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        }
+        return (binding == 6) ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    }
+};
+
+// One set per pyramid level: binding 0 samples the previous level (or the depth buffer for level 0) through the
+// max-reduction sampler, binding 1 is the level being written.
+class IrDepthReduceDescriptor
+{
+  public:
+    VkDescriptorSetLayout depthReduceDescriptorSetLayout;
+    std::array<VkDescriptorSet, maxDepthPyramidLevels> depthReduceDescriptorSets{};
+    bool allocated = false;
+
+    void createDepthReduceDescriptorSetLayouts()
+    {
+        std::array<VkDescriptorSetLayoutBinding, 2> Bindings{};
+        Bindings[0].binding = 0;
+        Bindings[0].descriptorCount = 1;
+        Bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        Bindings[0].pImmutableSamplers = nullptr;
+        Bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        Bindings[1].binding = 1;
+        Bindings[1].descriptorCount = 1;
+        Bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        Bindings[1].pImmutableSamplers = nullptr;
+        Bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        VkDescriptorSetLayoutCreateInfo createLayoutInfo{};
+
+        createLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        createLayoutInfo.bindingCount = Bindings.size();
+        createLayoutInfo.pBindings = Bindings.data();
+
+        if (vkCreateDescriptorSetLayout(device, &createLayoutInfo, nullptr, &depthReduceDescriptorSetLayout) !=
+            VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create descriptor set layout!");
+        }
+    }
+
+    // Sets for every possible level are allocated once; a resize only rewrites them.
+    void createDepthReduceDescriptorSet(uint32_t level, VkDescriptorImageInfo &srcInfo, VkDescriptorImageInfo &dstInfo)
+    {
+        if (!allocated)
+        {
+            std::vector<VkDescriptorSetLayout> layouts(maxDepthPyramidLevels, depthReduceDescriptorSetLayout);
+
+            VkDescriptorSetAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            allocInfo.pNext = nullptr;
+            allocInfo.descriptorPool = descriptorPool;
+            allocInfo.descriptorSetCount = maxDepthPyramidLevels;
+            allocInfo.pSetLayouts = layouts.data();
+
+            if (vkAllocateDescriptorSets(device, &allocInfo, depthReduceDescriptorSets.data()) != VK_SUCCESS)
+            {
+                throw std::runtime_error("create descriptorsets failed");
+            }
+            allocated = true;
+        }
+
+        std::array<VkWriteDescriptorSet, 2> writeDescriptorSets{};
+        writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeDescriptorSets[0].dstSet = depthReduceDescriptorSets[level];
+        writeDescriptorSets[0].dstBinding = 0;
+        writeDescriptorSets[0].dstArrayElement = 0;
+        writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writeDescriptorSets[0].descriptorCount = 1;
+        writeDescriptorSets[0].pImageInfo = &srcInfo;
+
+        writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeDescriptorSets[1].dstSet = depthReduceDescriptorSets[level];
+        writeDescriptorSets[1].dstBinding = 1;
+        writeDescriptorSets[1].dstArrayElement = 0;
+        writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writeDescriptorSets[1].descriptorCount = 1;
+        writeDescriptorSets[1].pImageInfo = &dstInfo;
+
+        vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, nullptr);
+    }
+};
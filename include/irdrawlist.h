@@ -0,0 +1,250 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "irbuffer.h"
+#include "resourceManager.h"
+#include "tglfUsage.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+enum IrPassMask : uint32_t
+{
+    IR_PASS_SHADOW = 1u << 0,
+    IR_PASS_MAIN = 1u << 1,
+};
+
+// Everything a pass needs to issue one primitive, resolved once after the model is loaded.
+struct IrDrawItem
+{
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    uint32_t passMask;
+    int32_t textureIndex; // index into the loaded images, -1 when there is no base color texture
+};
+
+// IrDrawItem as stored in the mesh cache.
+struct IrCookedDraw
+{
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    uint32_t passMask;
+    int32_t textureIndex;
+    uint32_t reserved;
+};
+
+// Object-space bounds of one draw, laid out for std430 so the cull shader can read the array directly.
+struct IrDrawBounds
+{
+    glm::vec4 sphere; // xyz center, w radius
+    glm::vec4 aabbMin;
+    glm::vec4 aabbMax;
+};
+
+class IrDrawList
+{
+  public:
+    std::vector<IrDrawItem> items;
+    std::vector<IrDrawBounds> bounds; // parallel to items
+
+    // Walks the default scene in the same order as loadScene, so primitive instance n draws primitiveChunks[n]:
+    // one item per chunk, all sharing the primitive's material.
+    void buildDrawList(const std::vector<std::vector<IrIndexChunk>> &primitiveChunks)
+    {
+        items.clear();
+        size_t primitiveIndex = 0;
+        const tinygltf::Scene &scene = model.scenes[model.defaultScene];
+        for (size_t i = 0; i < scene.nodes.size(); i++)
+        {
+            addNode(model.nodes[scene.nodes[i]], primitiveChunks, primitiveIndex);
+        }
+    }
+
+    // Restores a cooked draw list; bounds come with it, so computeBounds is not needed.
+    void loadCookedDrawList(const IrCookedDraw *draws, const IrDrawBounds *drawBounds, uint32_t drawCount)
+    {
+        items.clear();
+        for (uint32_t i = 0; i < drawCount; i++)
+        {
+            const IrCookedDraw &draw = draws[i];
+            items.push_back({draw.indexCount, draw.firstIndex, draw.vertexOffset, draw.passMask, draw.textureIndex});
+        }
+        bounds.assign(drawBounds, drawBounds + drawCount);
+    }
+
+    void computeBounds(const std::vector<glm::vec3> &positions, const std::vector<uint16_t> &indices)
+    {
+        bounds.resize(items.size());
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            const IrDrawItem &item = items[i];
+            glm::vec3 lo(std::numeric_limits<float>::max());
+            glm::vec3 hi(std::numeric_limits<float>::lowest());
+            for (uint32_t k = item.firstIndex; k < item.firstIndex + item.indexCount; k++)
+            {
+                const glm::vec3 &pos = positions[indices[k] + item.vertexOffset];
+                lo = glm::min(lo, pos);
+                hi = glm::max(hi, pos);
+            }
+            if (item.indexCount == 0)
+            {
+                lo = hi = glm::vec3(0.0f);
+            }
+
+            glm::vec3 center = (lo + hi) * 0.5f;
+            bounds[i].sphere = glm::vec4(center, glm::length(hi - center));
+            bounds[i].aabbMin = glm::vec4(lo, 1.0f);
+            bounds[i].aabbMax = glm::vec4(hi, 1.0f);
+        }
+    }
+
+  private:
+    void addNode(const tinygltf::Node &node, const std::vector<std::vector<IrIndexChunk>> &primitiveChunks,
+                 size_t &primitiveIndex)
+    {
+        if (node.mesh != -1)
+        {
+            for (const tinygltf::Primitive &primitive : model.meshes[node.mesh].primitives)
+            {
+                IrDrawItem item{};
+                item.passMask = IR_PASS_SHADOW | IR_PASS_MAIN;
+                item.textureIndex = -1;
+
+                if (primitive.material != -1)
+                {
+                    int textureIndex = model.materials[primitive.material].pbrMetallicRoughness.baseColorTexture.index;
+                    if (textureIndex != -1)
+                    {
+                        item.textureIndex = model.textures[textureIndex].source;
+                    }
+                }
+
+                for (const IrIndexChunk &chunk : primitiveChunks[primitiveIndex])
+                {
+                    item.indexCount = chunk.indexCount;
+                    item.firstIndex = chunk.firstIndex;
+                    item.vertexOffset = chunk.vertexOffset;
+                    items.push_back(item);
+                }
+                primitiveIndex++;
+            }
+        }
+
+        for (int child : node.children)
+        {
+            addNode(model.nodes[child], primitiveChunks, primitiveIndex);
+        }
+    }
+};
+
+// Per-draw data read by the indirect shaders through gl_InstanceIndex (firstInstance is the draw's slot).
+struct IrDrawMaterial
+{
+    int32_t textureIndex;
+    uint32_t flags;
+};
+
+struct IrIndirectRange
+{
+    VkDeviceSize offset;
+    uint32_t count;
+};
+
+// GPU copies of the draw list: one VkDrawIndexedIndirectCommand per draw and pass, plus the material SSBO.
+class IrIndirectDraws
+{
+  public:
+    IrBuffer indirectBuffer;
+    IrBuffer materialBuffer;
+    VkDescriptorBufferInfo materialBufferInfo;
+    IrIndirectRange shadowRange{};
+    IrIndirectRange mainRange{};
+
+    void createIndirectDraws(IrDrawList &drawList, IrUploadBatch &batch)
+    {
+        std::vector<VkDrawIndexedIndirectCommand> commands;
+        std::vector<IrDrawMaterial> materials;
+        materials.reserve(drawList.items.size());
+        for (const IrDrawItem &item : drawList.items)
+        {
+            materials.push_back({item.textureIndex, 0});
+        }
+
+        shadowRange = appendRange(drawList, IR_PASS_SHADOW, commands);
+        mainRange = appendRange(drawList, IR_PASS_MAIN, commands);
+
+        if (commands.empty())
+        {
+            commands.push_back({});
+        }
+        if (materials.empty())
+        {
+            materials.push_back({-1, 0});
+        }
+
+        // Also bound as a storage buffer: the cull pass reads it as its list of candidate commands.
+        uploadBuffer(batch, indirectBuffer, commands,
+                     VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        uploadBuffer(batch, materialBuffer, materials, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+        materialBufferInfo.buffer = materialBuffer.buffer;
+        materialBufferInfo.offset = 0;
+        materialBufferInfo.range = VK_WHOLE_SIZE;
+    }
+
+    void draw(VkCommandBuffer commandBuffer, uint32_t passMask)
+    {
+        const IrIndirectRange &range = (passMask & IR_PASS_SHADOW) ? shadowRange : mainRange;
+        const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+        // Without multiDrawIndirect the device only accepts drawCount <= 1, so fall back to one call per command.
+        uint32_t batch = multiDrawIndirectSupported ? maxDrawIndirectCount : 1;
+        for (uint32_t first = 0; first < range.count; first += batch)
+        {
+            uint32_t count = std::min(batch, range.count - first);
+            vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer.buffer, range.offset + first * stride, count,
+                                     stride);
+        }
+    }
+
+    template <typename T>
+    void uploadBuffer(IrUploadBatch &batch, IrBuffer &dst, std::vector<T> &data, VkBufferUsageFlags usage)
+    {
+        VkDeviceSize size = sizeof(T) * data.size();
+        dst.createIrBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, 0);
+        dst.uploadData(batch, data);
+    }
+
+  private:
+    IrIndirectRange appendRange(IrDrawList &drawList, uint32_t passMask,
+                                std::vector<VkDrawIndexedIndirectCommand> &commands)
+    {
+        IrIndirectRange range{};
+        range.offset = commands.size() * sizeof(VkDrawIndexedIndirectCommand);
+
+        for (uint32_t i = 0; i < drawList.items.size(); i++)
+        {
+            const IrDrawItem &item = drawList.items[i];
+            if (!(item.passMask & passMask))
+            {
+                continue;
+            }
+
+            VkDrawIndexedIndirectCommand command{};
+            command.indexCount = item.indexCount;
+            command.instanceCount = 1;
+            command.firstIndex = item.firstIndex;
+            command.vertexOffset = item.vertexOffset;
+            command.firstInstance = i;
+            commands.push_back(command);
+            range.count++;
+        }
+        return range;
+    }
+};
@@ -0,0 +1,125 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "resourceManager.h"
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// Tracks GPU progress with a single timeline semaphore. Every submission signals the next value of the
+// counter, and per-frame resources are retired by waiting for the exact value their last submission signaled.
+class IrFrameScheduler
+{
+  public:
+    VkSemaphore timeline;
+    uint64_t timelineValue = 0;
+    std::array<uint64_t, MAX_FRAMES_IN_FLIGHT> frameValues{};
+
+    void createFrameScheduler()
+    {
+        VkSemaphoreTypeCreateInfo typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = timelineValue;
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+
+        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &timeline) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create timeline semaphore!");
+        }
+    }
+
+    void destroyFrameScheduler()
+    {
+        vkDestroySemaphore(device, timeline, nullptr);
+    }
+
+    uint64_t completedValue()
+    {
+        uint64_t value = 0;
+        vkGetSemaphoreCounterValue(device, timeline, &value);
+        return value;
+    }
+
+    void wait(uint64_t value)
+    {
+        if (value == 0 || completedValue() >= value)
+        {
+            return;
+        }
+
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &timeline;
+        waitInfo.pValues = &value;
+
+        if (vkWaitSemaphores(device, &waitInfo, UINT64_MAX) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to wait for timeline semaphore!");
+        }
+    }
+
+    // Blocks until the previous submission that used this frame slot has finished on the GPU.
+    void beginFrame(uint32_t frame)
+    {
+        wait(frameValues[frame]);
+    }
+
+    // Submits commandBuffer, waiting on the timeline reaching waitValue (0 for none) plus any binary semaphores,
+    // and signals the next timeline value together with signalSemaphores. Returns the value that was signaled.
+    uint64_t submit(VkQueue queue, VkCommandBuffer commandBuffer, uint64_t waitValue, VkPipelineStageFlags waitStage,
+                    const std::vector<VkSemaphore> &waitSemaphores = {},
+                    const std::vector<VkPipelineStageFlags> &waitStages = {},
+                    const std::vector<VkSemaphore> &signalSemaphores = {})
+    {
+        uint64_t signalValue = ++timelineValue;
+
+        std::vector<VkSemaphore> waits = waitSemaphores;
+        std::vector<VkPipelineStageFlags> stages = waitStages;
+        // Binary semaphores ignore the value, but the array has to line up with pWaitSemaphores.
+        std::vector<uint64_t> waitValues(waits.size(), 0);
+        if (waitValue != 0)
+        {
+            waits.push_back(timeline);
+            stages.push_back(waitStage);
+            waitValues.push_back(waitValue);
+        }
+
+        std::vector<VkSemaphore> signals = signalSemaphores;
+        std::vector<uint64_t> signalValues(signals.size(), 0);
+        signals.push_back(timeline);
+        signalValues.push_back(signalValue);
+
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+        timelineInfo.pWaitSemaphoreValues = waitValues.data();
+        timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+        timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waits.size());
+        submitInfo.pWaitSemaphores = waits.data();
+        submitInfo.pWaitDstStageMask = stages.data();
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+        submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signals.size());
+        submitInfo.pSignalSemaphores = signals.data();
+
+        if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to submit command buffer!");
+        }
+
+        return signalValue;
+    }
+};
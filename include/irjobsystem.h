@@ -0,0 +1,305 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct IrJob
+{
+    std::function<void()> function;
+    std::atomic<uint32_t> pendingDependencies{1}; // the extra 1 is released once the job is fully scheduled
+    std::mutex mutex;
+    std::vector<std::shared_ptr<IrJob>> dependents; // guarded by mutex until finished is set
+    std::atomic<bool> finished{false};
+    std::exception_ptr error; // written before finished is set, read after
+};
+
+using IrJobHandle = std::shared_ptr<IrJob>;
+
+// Engine-wide work-stealing scheduler. Every worker owns a deque: it pushes and pops its own jobs at the back and,
+// when it runs dry, steals the oldest job from the front of another thread's deque. Threads outside the pool
+// (the main thread) share one more deque, and help execute jobs while they wait, so waiting inside a job is fine.
+//
+// A job only becomes runnable once all the jobs it depends on have finished. If a dependency fails, the job is
+// skipped and inherits the error, which wait() rethrows.
+class IrJobSystem
+{
+  public:
+    void createJobSystem(uint32_t workerCount = 0)
+    {
+        if (workerCount == 0)
+        {
+            // The main thread takes part in every wait, so it counts as one of the hardware threads.
+            workerCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+        }
+
+        queues = std::vector<Queue>(workerCount + 1);
+        stopping = false;
+        for (uint32_t i = 0; i < workerCount; i++)
+        {
+            workers.emplace_back(&IrJobSystem::workerLoop, this, i);
+        }
+    }
+
+    void destroyJobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        sleepCondition.notify_all();
+        for (std::thread &worker : workers)
+        {
+            worker.join();
+        }
+        workers.clear();
+        queues.clear();
+    }
+
+    ~IrJobSystem()
+    {
+        if (!workers.empty())
+        {
+            destroyJobSystem();
+        }
+    }
+
+    // Worker threads plus the shared slot of outside threads; per-thread resources are sized by this.
+    uint32_t threadCount() const
+    {
+        return static_cast<uint32_t>(queues.size());
+    }
+
+    // In [0, threadCount()); every thread outside the pool maps to threadCount() - 1, so per-thread resources
+    // indexed by it may only be used from one outside thread at a time.
+    uint32_t threadIndex() const
+    {
+        return (currentSystem == this) ? currentIndex : threadCount() - 1;
+    }
+
+    IrJobHandle schedule(std::function<void()> function, const std::vector<IrJobHandle> &dependencies = {})
+    {
+        IrJobHandle job = std::make_shared<IrJob>();
+        job->function = std::move(function);
+
+        for (const IrJobHandle &dependency : dependencies)
+        {
+            std::lock_guard<std::mutex> lock(dependency->mutex);
+            if (!dependency->finished)
+            {
+                job->pendingDependencies++;
+                dependency->dependents.push_back(job);
+            }
+            else if (dependency->error && !job->error)
+            {
+                job->error = dependency->error;
+            }
+        }
+
+        if (--job->pendingDependencies == 0)
+        {
+            push(job);
+        }
+        return job;
+    }
+
+    // Non-blocking: whether job has run (or been skipped); wait() then returns at once and rethrows its error. A null
+    // handle counts as finished.
+    bool isFinished(const IrJobHandle &job) const
+    {
+        return !job || job->finished;
+    }
+
+    // Runs other jobs until job has finished, then rethrows its error if it failed.
+    void wait(const IrJobHandle &job)
+    {
+        while (!job->finished)
+        {
+            if (!runOne())
+            {
+                std::this_thread::yield();
+            }
+        }
+        if (job->error)
+        {
+            std::rethrow_exception(job->error);
+        }
+    }
+
+    // Waits for all of jobs before rethrowing the first error, so none is still running on caller-owned data.
+    void wait(const std::vector<IrJobHandle> &jobs)
+    {
+        std::exception_ptr error;
+        for (const IrJobHandle &job : jobs)
+        {
+            try
+            {
+                wait(job);
+            }
+            catch (...)
+            {
+                if (!error)
+                {
+                    error = std::current_exception();
+                }
+            }
+        }
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // Calls function(first, count) over [0, itemCount) in batches of at least minBatch items, spread over all
+    // threads, and returns once every batch is done.
+    void parallelFor(uint32_t itemCount, uint32_t minBatch, const std::function<void(uint32_t, uint32_t)> &function)
+    {
+        if (itemCount == 0)
+        {
+            return;
+        }
+        uint32_t batch = std::max(std::max(minBatch, 1u), (itemCount + threadCount() - 1) / threadCount());
+        std::vector<IrJobHandle> jobs;
+        for (uint32_t first = 0; first < itemCount; first += batch)
+        {
+            uint32_t count = std::min(batch, itemCount - first);
+            jobs.push_back(schedule([&function, first, count]() { function(first, count); }));
+        }
+        wait(jobs);
+    }
+
+  private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<IrJobHandle> jobs;
+    };
+
+    std::vector<Queue> queues;
+    std::vector<std::thread> workers;
+    std::atomic<int32_t> queuedJobs{0}; // counted before the push, so it never drops below zero
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+    bool stopping = false;
+
+    static inline thread_local IrJobSystem *currentSystem = nullptr;
+    static inline thread_local uint32_t currentIndex = 0;
+
+    void push(const IrJobHandle &job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queuedJobs++;
+        }
+        Queue &queue = queues[threadIndex()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(job);
+        }
+        sleepCondition.notify_one();
+    }
+
+    // Own deque first (newest job, still warm in cache), then the oldest job of every other deque in turn.
+    IrJobHandle pop()
+    {
+        uint32_t self = threadIndex();
+        for (uint32_t i = 0; i < threadCount(); i++)
+        {
+            Queue &queue = queues[(self + i) % threadCount()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.jobs.empty())
+            {
+                IrJobHandle job;
+                if (i == 0)
+                {
+                    job = std::move(queue.jobs.back());
+                    queue.jobs.pop_back();
+                }
+                else
+                {
+                    job = std::move(queue.jobs.front());
+                    queue.jobs.pop_front();
+                }
+                queuedJobs--;
+                return job;
+            }
+        }
+        return nullptr;
+    }
+
+    bool runOne()
+    {
+        IrJobHandle job = pop();
+        if (!job)
+        {
+            return false;
+        }
+        execute(job);
+        return true;
+    }
+
+    void execute(const IrJobHandle &job)
+    {
+        if (!job->error)
+        {
+            try
+            {
+                job->function();
+            }
+            catch (...)
+            {
+                job->error = std::current_exception();
+            }
+        }
+        job->function = nullptr;
+
+        std::vector<IrJobHandle> dependents;
+        {
+            std::lock_guard<std::mutex> lock(job->mutex);
+            job->finished = true;
+            dependents.swap(job->dependents);
+        }
+        for (IrJobHandle &dependent : dependents)
+        {
+            if (job->error)
+            {
+                std::lock_guard<std::mutex> lock(dependent->mutex);
+                if (!dependent->error)
+                {
+                    dependent->error = job->error;
+                }
+            }
+            if (--dependent->pendingDependencies == 0)
+            {
+                push(dependent);
+            }
+        }
+    }
+
+    void workerLoop(uint32_t index)
+    {
+        currentSystem = this;
+        currentIndex = index;
+        while (true)
+        {
+            if (runOne())
+            {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepCondition.wait(lock, [this]() { return stopping || queuedJobs > 0; });
+            if (stopping)
+            {
+                return;
+            }
+        }
+    }
+};
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file. Pages are faulted in from the page cache on first touch and, being
+// file-backed and clean, can be dropped again under memory pressure instead of counting against the process.
+class IrMappedFile
+{
+  public:
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+
+    IrMappedFile() = default;
+    IrMappedFile(const IrMappedFile &) = delete;
+    IrMappedFile &operator=(const IrMappedFile &) = delete;
+
+    ~IrMappedFile()
+    {
+        unmap();
+    }
+
+    bool map(const std::string &path)
+    {
+        unmap();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        {
+            unmap();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping)
+        {
+            unmap();
+            return false;
+        }
+        data = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        size = static_cast<size_t>(fileSize.QuadPart);
+#else
+        file = open(path.c_str(), O_RDONLY);
+        if (file < 0)
+        {
+            return false;
+        }
+        struct stat info;
+        if (fstat(file, &info) != 0 || info.st_size == 0)
+        {
+            unmap();
+            return false;
+        }
+        void *view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+        if (view == MAP_FAILED)
+        {
+            unmap();
+            return false;
+        }
+        madvise(view, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+        data = static_cast<const uint8_t *>(view);
+        size = static_cast<size_t>(info.st_size);
+#endif
+        if (!data)
+        {
+            unmap();
+            return false;
+        }
+        return true;
+    }
+
+    void unmap()
+    {
+#ifdef _WIN32
+        if (data)
+        {
+            UnmapViewOfFile(data);
+        }
+        if (mapping)
+        {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(file);
+        }
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data)
+        {
+            munmap(const_cast<uint8_t *>(data), size);
+        }
+        if (file >= 0)
+        {
+            close(file);
+        }
+        file = -1;
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+  private:
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int file = -1;
+#endif
+};
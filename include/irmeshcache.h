@@ -0,0 +1,336 @@
+#pragma once
+
+#include "geometry.h"
+#include "irdrawlist.h"
+#include "irjobsystem.h"
+#include "irmappedfile.h"
+#include "irmeshlet.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+struct IrCacheSection
+{
+    uint64_t offset; // from the start of the file, page aligned
+    uint64_t size;
+};
+
+// One RGBA8 texture in the pixels section.
+struct IrCookedImage
+{
+    uint32_t width;
+    uint32_t height;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct IrMeshCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexSize; // sizeof(IrPackedVertex) and sizeof(IrCookedDraw) when cooked, so layout changes invalidate
+    uint32_t drawSize;
+    uint32_t importFlags; // importFlags() when cooked, so changing an import option invalidates
+    uint32_t reserved;
+    uint64_t sourceSize;
+    int64_t sourceWriteTime;
+    uint64_t sourceHash;
+    float modelBounds[6]; // xl, xr, yb, yt, zb, zf
+    uint32_t drawCount;
+    uint32_t imageCount;
+    uint32_t meshletCount;
+    uint32_t meshletSize; // sizeof(IrMeshlet)
+    IrCacheSection vertices;  // IrPackedVertex
+    IrCacheSection positions; // glm::vec3, parallel to vertices
+    IrCacheSection indices;   // uint16_t, relative to each draw's vertexOffset
+    IrCacheSection draws;
+    IrCacheSection drawBounds; // IrDrawBounds, parallel to draws
+    IrCacheSection meshlets;   // IrMeshlet
+    IrCacheSection images;     // IrCookedImage table
+    IrCacheSection pixels;
+};
+
+// The import result of one glTF file, cooked into <source>.ircache: the packed vertex, position and index arrays,
+// draw ranges with their bounds, the meshlets, the material (texture) table and the decoded textures, each in its own
+// page-aligned section so the file can be mapped and its sections copied straight into staging memory.
+//
+// The cache is keyed by a hash of the source file. Size and modification time are checked first and the hash is
+// only recomputed when the time differs, so an unchanged source costs nothing to validate. When only the time
+// changed, open() stores the new one in the header.
+class IrMeshCache
+{
+  public:
+    static const uint32_t magic = 0x434D5249; // "IRMC"
+    static const uint32_t version = 6;
+    static const uint64_t pageSize = 4096;
+
+    IrMappedFile file;
+    const IrMeshCacheHeader *header = nullptr;
+
+    static uint32_t importFlags()
+    {
+        return (weldVertices ? 1u : 0u) | (optimizeMeshes ? 2u : 0u);
+    }
+
+    static std::string cachePath(const std::string &source)
+    {
+        return source + ".ircache";
+    }
+
+    bool isOpen() const
+    {
+        return header != nullptr;
+    }
+
+    // Maps the cache of source if it exists and matches source; returns false (and stays closed) otherwise.
+    bool open(const std::string &source, IrJobSystem &jobSystem)
+    {
+        close();
+
+        std::error_code error;
+        uint64_t sourceSize = std::filesystem::file_size(source, error);
+        if (error || !file.map(cachePath(source)))
+        {
+            return false;
+        }
+
+        if (!headerMatches(sourceSize))
+        {
+            file.unmap();
+            return false;
+        }
+
+        const IrMeshCacheHeader *candidate = reinterpret_cast<const IrMeshCacheHeader *>(file.data);
+        int64_t sourceTime = writeTime(source);
+        if (candidate->sourceWriteTime != sourceTime)
+        {
+            if (candidate->sourceHash != hashFile(source, jobSystem))
+            {
+                file.unmap();
+                return false;
+            }
+
+            // Same contents under a new time, e.g. after a copy or a checkout. Storing the time spares the next
+            // start the hash. The mapping is read-only (and shuts out writers on Windows), so the header is patched
+            // unmapped and checked again after mapping it anew.
+            file.unmap();
+            storeWriteTime(cachePath(source), sourceTime);
+            if (!file.map(cachePath(source)) || !headerMatches(sourceSize))
+            {
+                file.unmap();
+                return false;
+            }
+        }
+
+        header = reinterpret_cast<const IrMeshCacheHeader *>(file.data);
+        return true;
+    }
+
+    void close()
+    {
+        header = nullptr;
+        file.unmap();
+    }
+
+    template <typename T> const T *section(const IrCacheSection &s) const
+    {
+        return reinterpret_cast<const T *>(file.data + s.offset);
+    }
+
+    // Writes the cache next to source, through a temporary file so a crash never leaves a torn cache behind.
+    static void cook(const std::string &source, IrJobSystem &jobSystem, const std::vector<IrPackedVertex> &vertices,
+                     const std::vector<glm::vec3> &positions, const std::vector<uint16_t> &indices,
+                     const IrDrawList &drawList, const std::vector<IrMeshlet> &meshlets,
+                     const std::vector<tinygltf::Image> &images, const float (&modelBounds)[6])
+    {
+        IrMeshCacheHeader h{};
+        h.magic = magic;
+        h.version = version;
+        h.vertexSize = sizeof(IrPackedVertex);
+        h.drawSize = sizeof(IrCookedDraw);
+        h.importFlags = importFlags();
+        std::error_code error;
+        h.sourceSize = std::filesystem::file_size(source, error);
+        h.sourceWriteTime = writeTime(source);
+        h.sourceHash = hashFile(source, jobSystem);
+        std::memcpy(h.modelBounds, modelBounds, sizeof(h.modelBounds));
+        h.drawCount = static_cast<uint32_t>(drawList.items.size());
+        h.imageCount = static_cast<uint32_t>(images.size());
+        h.meshletCount = static_cast<uint32_t>(meshlets.size());
+        h.meshletSize = sizeof(IrMeshlet);
+
+        std::vector<IrCookedDraw> draws;
+        for (const IrDrawItem &item : drawList.items)
+        {
+            draws.push_back({item.indexCount, item.firstIndex, item.vertexOffset, item.passMask, item.textureIndex, 0});
+        }
+
+        std::string temporary = cachePath(source) + ".tmp";
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            return;
+        }
+        out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+
+        h.vertices = writeSection(out, vertices.data(), vertices.size() * sizeof(IrPackedVertex));
+        h.positions = writeSection(out, positions.data(), positions.size() * sizeof(glm::vec3));
+        h.indices = writeSection(out, indices.data(), indices.size() * sizeof(uint16_t));
+        h.draws = writeSection(out, draws.data(), draws.size() * sizeof(IrCookedDraw));
+        h.drawBounds = writeSection(out, drawList.bounds.data(), drawList.bounds.size() * sizeof(IrDrawBounds));
+        h.meshlets = writeSection(out, meshlets.data(), meshlets.size() * sizeof(IrMeshlet));
+
+        std::vector<IrCookedImage> table;
+        for (const tinygltf::Image &image : images)
+        {
+            IrCacheSection pixels = writeSection(out, image.image.data(), image.image.size());
+            table.push_back({static_cast<uint32_t>(image.width), static_cast<uint32_t>(image.height), pixels.offset,
+                             pixels.size});
+        }
+        h.pixels = {table.empty() ? 0 : table.front().offset, 0};
+        for (const IrCookedImage &image : table)
+        {
+            h.pixels.size = image.offset + image.size - h.pixels.offset;
+        }
+        h.images = writeSection(out, table.data(), table.size() * sizeof(IrCookedImage));
+
+        out.seekp(0);
+        out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+        out.close();
+        if (!out)
+        {
+            std::filesystem::remove(temporary, error);
+            return;
+        }
+        std::filesystem::rename(temporary, cachePath(source), error);
+    }
+
+  private:
+    // Everything but the source time and hash, against the mapped file.
+    bool headerMatches(uint64_t sourceSize) const
+    {
+        const IrMeshCacheHeader *candidate = reinterpret_cast<const IrMeshCacheHeader *>(file.data);
+        return file.size >= sizeof(IrMeshCacheHeader) && candidate->magic == magic && candidate->version == version &&
+               candidate->vertexSize == sizeof(IrPackedVertex) && candidate->drawSize == sizeof(IrCookedDraw) &&
+               candidate->meshletSize == sizeof(IrMeshlet) && candidate->importFlags == importFlags() &&
+               candidate->sourceSize == sourceSize && sectionsFit(*candidate);
+    }
+
+    bool sectionsFit(const IrMeshCacheHeader &h) const
+    {
+        for (const IrCacheSection &s :
+             {h.vertices, h.positions, h.indices, h.draws, h.drawBounds, h.meshlets, h.images, h.pixels})
+        {
+            if (s.offset > file.size || s.size > file.size - s.offset)
+            {
+                return false;
+            }
+        }
+        if (h.positions.size / sizeof(glm::vec3) != h.vertices.size / sizeof(IrPackedVertex) ||
+            h.draws.size != h.drawCount * sizeof(IrCookedDraw) ||
+            h.drawBounds.size != h.drawCount * sizeof(IrDrawBounds) ||
+            h.meshlets.size != uint64_t(h.meshletCount) * sizeof(IrMeshlet) ||
+            h.images.size != h.imageCount * sizeof(IrCookedImage))
+        {
+            return false;
+        }
+
+        const IrCookedImage *images = reinterpret_cast<const IrCookedImage *>(file.data + h.images.offset);
+        for (uint32_t i = 0; i < h.imageCount; i++)
+        {
+            if (images[i].offset > file.size || images[i].size > file.size - images[i].offset ||
+                images[i].size != uint64_t(images[i].width) * images[i].height * 4)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static IrCacheSection writeSection(std::ofstream &out, const void *data, uint64_t size)
+    {
+        uint64_t offset = static_cast<uint64_t>(out.tellp());
+        uint64_t aligned = (offset + pageSize - 1) / pageSize * pageSize;
+        static const char zeros[pageSize] = {};
+        out.write(zeros, static_cast<std::streamsize>(aligned - offset));
+        out.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+        return {aligned, size};
+    }
+
+    // Best effort: if the write fails, the next start only hashes the source again.
+    static void storeWriteTime(const std::string &path, int64_t time)
+    {
+        std::fstream out(path, std::ios::binary | std::ios::in | std::ios::out);
+        if (out)
+        {
+            out.seekp(offsetof(IrMeshCacheHeader, sourceWriteTime));
+            out.write(reinterpret_cast<const char *>(&time), sizeof(time));
+        }
+    }
+
+    static int64_t writeTime(const std::string &path)
+    {
+        std::error_code error;
+        auto time = std::filesystem::last_write_time(path, error);
+        return error ? 0 : static_cast<int64_t>(time.time_since_epoch().count());
+    }
+
+    static uint64_t mix(uint64_t x)
+    {
+        x ^= x >> 30;
+        x *= 0xBF58476D1CE4E5B9ull;
+        x ^= x >> 27;
+        x *= 0x94D049BB133111EBull;
+        x ^= x >> 31;
+        return x;
+    }
+
+    static uint64_t hashBytes(const uint8_t *data, size_t size)
+    {
+        uint64_t h = mix(size);
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, data + i, sizeof(word));
+            h = (h ^ mix(word)) * 0x9E3779B97F4A7C15ull;
+        }
+        uint64_t tail = 0;
+        std::memcpy(&tail, data + i, size - i);
+        return mix(h ^ mix(tail));
+    }
+
+    // Hashes 64 MiB chunks of the file in parallel and folds the chunk hashes in order.
+    static uint64_t hashFile(const std::string &path, IrJobSystem &jobSystem)
+    {
+        IrMappedFile source;
+        if (!source.map(path))
+        {
+            return 0;
+        }
+
+        const size_t chunkSize = size_t(64) << 20;
+        uint32_t chunks = static_cast<uint32_t>((source.size + chunkSize - 1) / chunkSize);
+        std::vector<uint64_t> chunkHashes(chunks);
+        jobSystem.parallelFor(chunks, 1, [&](uint32_t first, uint32_t count) {
+            for (uint32_t c = first; c < first + count; c++)
+            {
+                size_t offset = c * chunkSize;
+                chunkHashes[c] = hashBytes(source.data + offset, std::min(chunkSize, source.size - offset));
+            }
+        });
+
+        uint64_t h = mix(source.size);
+        for (uint64_t chunkHash : chunkHashes)
+        {
+            h = mix(h ^ chunkHash) * 0x9E3779B97F4A7C15ull;
+        }
+        return h;
+    }
+};
@@ -0,0 +1,170 @@
+#pragma once
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include "geometry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// A cluster of at most maxVertices distinct vertices and maxTriangles triangles, laid out for std430 so
+// cluster_cull.comp reads the array directly. Its triangles are a contiguous range of its draw's indices, so a
+// surviving meshlet is drawn with an ordinary VkDrawIndexedIndirectCommand.
+//
+// The normal cone bounds the facing of every triangle: the whole cluster is back facing, and can be skipped, when
+// dot(normalize(coneApex - camera), coneAxis) >= coneAxis.w. A cutoff above 1 never culls.
+struct IrMeshlet
+{
+    static const uint32_t maxVertices = 64;
+    static const uint32_t maxTriangles = 124;
+
+    glm::vec4 sphere;   // xyz center, w radius
+    glm::vec4 coneApex; // xyz apex, w unused
+    glm::vec4 coneAxis; // xyz axis, w cutoff: the sine of the cone's half angle
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t vertexOffset;
+    uint32_t drawIndex; // draw list item the meshlet belongs to, passed as firstInstance for its material
+};
+
+// Bounding sphere and normal cone of the triangles [firstIndex, firstIndex + indexCount) of one meshlet, the same
+// construction as meshoptimizer's meshopt_computeClusterBounds: the axis is the average triangle normal, the
+// cutoff follows from the widest triangle and the apex is moved back until every triangle's plane is in front of
+// it. Cones close to a hemisphere or wider, and clusters of degenerate triangles, get no cone.
+inline void computeMeshletBounds(IrMeshlet &meshlet, const Vertex *vertices, const uint16_t *indices)
+{
+    const uint16_t *local = indices + meshlet.firstIndex;
+    const Vertex *base = vertices + meshlet.vertexOffset;
+
+    glm::vec3 lo(std::numeric_limits<float>::max());
+    glm::vec3 hi(std::numeric_limits<float>::lowest());
+    for (uint32_t i = 0; i < meshlet.indexCount; i++)
+    {
+        lo = glm::min(lo, base[local[i]].pos);
+        hi = glm::max(hi, base[local[i]].pos);
+    }
+    glm::vec3 center = (lo + hi) * 0.5f;
+    float radius = 0.0f;
+    for (uint32_t i = 0; i < meshlet.indexCount; i++)
+    {
+        radius = std::max(radius, glm::length(base[local[i]].pos - center));
+    }
+    meshlet.sphere = glm::vec4(center, radius);
+    meshlet.coneApex = glm::vec4(center, 0.0f);
+    meshlet.coneAxis = glm::vec4(0.0f, 0.0f, 1.0f, 2.0f);
+
+    uint32_t triangleCount = meshlet.indexCount / 3;
+    std::vector<glm::vec3> normals;
+    normals.reserve(triangleCount);
+    std::vector<uint32_t> triangles;
+    triangles.reserve(triangleCount);
+    glm::vec3 axis(0.0f);
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        const glm::vec3 &a = base[local[t * 3]].pos;
+        const glm::vec3 &b = base[local[t * 3 + 1]].pos;
+        const glm::vec3 &c = base[local[t * 3 + 2]].pos;
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float length = glm::length(normal);
+        if (length == 0.0f)
+        {
+            continue;
+        }
+        normals.push_back(normal / length);
+        triangles.push_back(t);
+        axis += normals.back();
+    }
+
+    float axisLength = glm::length(axis);
+    if (normals.empty() || axisLength == 0.0f)
+    {
+        return;
+    }
+    axis /= axisLength;
+
+    float minDot = 1.0f;
+    for (const glm::vec3 &normal : normals)
+    {
+        minDot = std::min(minDot, glm::dot(normal, axis));
+    }
+    // Below about 84 degrees off the axis the apex runs away to infinity and the cone culls next to nothing.
+    if (minDot <= 0.1f)
+    {
+        return;
+    }
+
+    float maxT = 0.0f;
+    for (size_t k = 0; k < normals.size(); k++)
+    {
+        const glm::vec3 &a = base[local[triangles[k] * 3]].pos;
+        maxT = std::max(maxT, glm::dot(center - a, normals[k]) / glm::dot(axis, normals[k]));
+    }
+
+    meshlet.coneApex = glm::vec4(center - axis * maxT, 0.0f);
+    meshlet.coneAxis = glm::vec4(axis, std::sqrt(1.0f - minDot * minDot));
+}
+
+// Cuts the 16-bit index chunk [firstIndex, firstIndex + indexCount) into meshlets, greedily in triangle order: a
+// triangle that would take the open meshlet past maxVertices or maxTriangles starts the next one. The chunk's
+// triangles are already ordered for the vertex cache, which keeps neighbours together, so the scan produces
+// compact clusters without moving any index.
+inline void buildMeshlets(const IrIndexChunk &chunk, uint32_t drawIndex, const Vertex *vertices,
+                          const uint16_t *indices, std::vector<IrMeshlet> &meshlets)
+{
+    uint32_t end = chunk.firstIndex + chunk.indexCount;
+    uint16_t maxIndex = 0;
+    for (uint32_t i = chunk.firstIndex; i < end; i++)
+    {
+        maxIndex = std::max(maxIndex, indices[i]);
+    }
+    // Per chunk-local vertex, the meshlet (counted from 1) that last took it in.
+    std::vector<uint32_t> owner(size_t(maxIndex) + 1, 0);
+    uint32_t meshletId = 1;
+
+    IrMeshlet meshlet{};
+    meshlet.firstIndex = chunk.firstIndex;
+    meshlet.vertexOffset = chunk.vertexOffset;
+    meshlet.drawIndex = drawIndex;
+    uint32_t vertexCount = 0;
+
+    auto finish = [&]() {
+        computeMeshletBounds(meshlet, vertices, indices);
+        meshlets.push_back(meshlet);
+        meshlet.firstIndex += meshlet.indexCount;
+        meshlet.indexCount = 0;
+        vertexCount = 0;
+        meshletId++;
+    };
+
+    for (uint32_t t = chunk.firstIndex; t + 2 < end; t += 3)
+    {
+        uint32_t added = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            added += (owner[indices[t + k]] != meshletId) ? 1 : 0;
+        }
+        // A degenerate triangle may count a new vertex twice, which at worst closes the meshlet one triangle early.
+        if (vertexCount + added > IrMeshlet::maxVertices || meshlet.indexCount / 3 == IrMeshlet::maxTriangles)
+        {
+            finish();
+        }
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t &mark = owner[indices[t + k]];
+            if (mark != meshletId)
+            {
+                mark = meshletId;
+                vertexCount++;
+            }
+        }
+        meshlet.indexCount += 3;
+    }
+    if (meshlet.indexCount != 0)
+    {
+        finish();
+    }
+}
@@ -0,0 +1,302 @@
+#pragma once
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include "geometry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+// Import-time reordering of one indexed triangle list whose indices run from 0 to vertexCount - 1. Triangles are
+// first ordered for the post-transform vertex cache, then cache-friendly clusters of them are ordered to reduce
+// overdraw, and finally vertices are renumbered in first-use order so vertex fetch walks memory linearly.
+//
+// Only the order changes: every triangle keeps its winding and every vertex its attributes.
+
+// Post-transform cache misses of a FIFO cache of cacheSize entries, the model hardware caches approximate. Divided
+// by the triangle count this is the ACMR (1.0 is excellent, 3.0 the worst), by the vertex count the ATVR (1.0 is
+// optimal: every vertex is shaded exactly once).
+inline size_t simulateVertexCache(const uint32_t *indices, size_t indexCount, size_t vertexCount,
+                                  uint32_t cacheSize = 16)
+{
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    size_t misses = 0;
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        uint32_t v = indices[i];
+        if (time - timestamps[v] > cacheSize)
+        {
+            timestamps[v] = time++;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+// Tom Forsyth's linear-speed vertex cache optimisation: greedily emits the triangle with the highest score, where
+// vertices score by their position in a simulated LRU cache and by how few triangles they have left.
+inline void optimizeVertexCache(uint32_t *indices, size_t indexCount, size_t vertexCount)
+{
+    const int cacheSize = 32;
+    const float cacheDecayPower = 1.5f;
+    const float lastTriangleScore = 0.75f;
+    const float valenceBoostScale = 2.0f;
+    const float valenceBoostPower = 0.5f;
+
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2)
+    {
+        return;
+    }
+
+    // Triangles of every vertex, compacted as they are emitted: the first liveTriangles[v] entries are still live.
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+    {
+        adjacencyOffsets[indices[i] + 1]++;
+    }
+    std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+    std::vector<uint32_t> liveTriangles(vertexCount, 0);
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t v = indices[t * 3 + k];
+            adjacency[adjacencyOffsets[v] + liveTriangles[v]++] = static_cast<uint32_t>(t);
+        }
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    auto vertexScore = [&](uint32_t v) {
+        if (liveTriangles[v] == 0)
+        {
+            return -1.0f;
+        }
+        float score = 0.0f;
+        int position = cachePosition[v];
+        if (position >= 0)
+        {
+            // The three vertices of the triangle just emitted score the same, whichever order they went in.
+            score = (position < 3) ? lastTriangleScore
+                                   : std::pow(1.0f - float(position - 3) / (cacheSize - 3), cacheDecayPower);
+        }
+        return score + valenceBoostScale * std::pow(float(liveTriangles[v]), -valenceBoostPower);
+    };
+
+    std::vector<float> scores(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        scores[v] = vertexScore(static_cast<uint32_t>(v));
+    }
+    std::vector<float> triangleScores(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        triangleScores[t] = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+    }
+
+    auto rescore = [&](uint32_t v) {
+        float delta = vertexScore(v) - scores[v];
+        scores[v] += delta;
+        for (uint32_t i = 0; i < liveTriangles[v]; i++)
+        {
+            triangleScores[adjacency[adjacencyOffsets[v] + i]] += delta;
+        }
+    };
+
+    std::vector<uint32_t> ordered(triangleCount * 3);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> nextCache;
+    cache.reserve(cacheSize + 3);
+    nextCache.reserve(cacheSize + 3);
+
+    size_t best = std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin();
+    size_t scanCursor = 0; // every triangle before it has been emitted
+    for (size_t out = 0; out < triangleCount; out++)
+    {
+        if (best == triangleCount)
+        {
+            // Nothing in the cache has triangles left; like meshoptimizer, take the next unemitted triangle rather
+            // than rescanning all of them for the best score.
+            while (emitted[scanCursor])
+            {
+                scanCursor++;
+            }
+            best = scanCursor;
+        }
+
+        const uint32_t *triangle = indices + best * 3;
+        std::copy(triangle, triangle + 3, ordered.begin() + out * 3);
+        emitted[best] = true;
+
+        nextCache.assign(triangle, triangle + 3);
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t v = triangle[k];
+            uint32_t *live = adjacency.data() + adjacencyOffsets[v];
+            uint32_t *found = std::find(live, live + liveTriangles[v], static_cast<uint32_t>(best));
+            *found = live[--liveTriangles[v]];
+        }
+        for (uint32_t v : cache)
+        {
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+            {
+                nextCache.push_back(v);
+            }
+        }
+        for (size_t i = cacheSize; i < nextCache.size(); i++)
+        {
+            cachePosition[nextCache[i]] = -1;
+            rescore(nextCache[i]);
+        }
+        nextCache.resize(std::min<size_t>(nextCache.size(), cacheSize));
+        cache.swap(nextCache);
+
+        // Rescore the cached vertices and their triangles, and pick the best of those triangles for the next step.
+        for (size_t i = 0; i < cache.size(); i++)
+        {
+            cachePosition[cache[i]] = static_cast<int>(i);
+        }
+        for (uint32_t v : cache)
+        {
+            rescore(v);
+        }
+        best = triangleCount;
+        float bestScore = -1.0f;
+        for (uint32_t v : cache)
+        {
+            for (uint32_t i = 0; i < liveTriangles[v]; i++)
+            {
+                uint32_t t = adjacency[adjacencyOffsets[v] + i];
+                if (triangleScores[t] > bestScore)
+                {
+                    bestScore = triangleScores[t];
+                    best = t;
+                }
+            }
+        }
+    }
+
+    std::copy(ordered.begin(), ordered.end(), indices);
+}
+
+// Splits a cache-optimized triangle list into clusters where the vertex cache starts over (a triangle that misses on
+// all three vertices), then sorts the clusters so the ones facing away from the mesh centre, which tend to occlude
+// the rest, are drawn first. Splitting only at such triangles keeps the vertex cache efficiency nearly unchanged.
+inline void optimizeOverdraw(uint32_t *indices, size_t indexCount, const Vertex *vertices, size_t vertexCount)
+{
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2)
+    {
+        return;
+    }
+
+    const uint32_t cacheSize = 16;
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    std::vector<size_t> clusterStarts;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        int misses = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t v = indices[t * 3 + k];
+            if (time - timestamps[v] > cacheSize)
+            {
+                timestamps[v] = time++;
+                misses++;
+            }
+        }
+        if (t == 0 || misses == 3)
+        {
+            clusterStarts.push_back(t);
+        }
+    }
+    clusterStarts.push_back(triangleCount);
+    size_t clusterCount = clusterStarts.size() - 1;
+    if (clusterCount < 2)
+    {
+        return;
+    }
+
+    glm::vec3 meshCentroid(0.0f);
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        meshCentroid += vertices[indices[i]].pos;
+    }
+    meshCentroid /= float(indexCount);
+
+    std::vector<float> sortKeys(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        glm::vec3 centroid(0.0f);
+        glm::vec3 normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+        {
+            const glm::vec3 &a = vertices[indices[t * 3]].pos;
+            const glm::vec3 &b = vertices[indices[t * 3 + 1]].pos;
+            const glm::vec3 &d = vertices[indices[t * 3 + 2]].pos;
+            glm::vec3 weightedNormal = glm::cross(b - a, d - a); // length is twice the area
+            float triangleArea = glm::length(weightedNormal);
+            centroid += (a + b + d) * (triangleArea / 3.0f);
+            normal += weightedNormal;
+            area += triangleArea;
+        }
+        float normalLength = glm::length(normal);
+        sortKeys[c] = (area > 0.0f && normalLength > 0.0f)
+                          ? glm::dot(centroid / area - meshCentroid, normal / normalLength)
+                          : 0.0f;
+    }
+
+    std::vector<uint32_t> clusterOrder(clusterCount);
+    std::iota(clusterOrder.begin(), clusterOrder.end(), 0u);
+    std::stable_sort(clusterOrder.begin(), clusterOrder.end(),
+                     [&](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<uint32_t> ordered;
+    ordered.reserve(triangleCount * 3);
+    for (uint32_t c : clusterOrder)
+    {
+        ordered.insert(ordered.end(), indices + clusterStarts[c] * 3, indices + clusterStarts[c + 1] * 3);
+    }
+    std::copy(ordered.begin(), ordered.end(), indices);
+}
+
+// Renumbers vertices in the order the index list first uses them and moves them accordingly. Vertices no triangle
+// uses keep their relative order after all used ones.
+inline void optimizeVertexFetch(uint32_t *indices, size_t indexCount, Vertex *vertices, size_t vertexCount)
+{
+    const uint32_t unassigned = UINT32_MAX;
+    std::vector<uint32_t> remap(vertexCount, unassigned);
+    uint32_t next = 0;
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        uint32_t &target = remap[indices[i]];
+        if (target == unassigned)
+        {
+            target = next++;
+        }
+        indices[i] = target;
+    }
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        if (remap[v] == unassigned)
+        {
+            remap[v] = next++;
+        }
+    }
+
+    std::vector<Vertex> reordered(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        reordered[remap[v]] = vertices[v];
+    }
+    std::copy(reordered.begin(), reordered.end(), vertices);
+}
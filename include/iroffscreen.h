@@ -55,7 +55,7 @@ class IrOffscreenResource
         descriptorImageInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
     }
 
-    void createOffscreenUniformBuffer(UniformScreen &ubo)
+    void createOffscreenUniformBuffer(IrUploadBatch &batch, UniformScreen &ubo)
     {
         // Matrix from light's point of view
         glm::mat4 depthProjectionMatrix = glm::perspective(glm::radians(45.0f), 1.0f, 1.0f, 96.0f);
@@ -65,6 +65,6 @@ class IrOffscreenResource
 
         uos.depthMVP = depthProjectionMatrix * depthViewMatrix * depthModelMatrix;
         ubo.depthMVP = uos.depthMVP;
-        uniformOffscreen.copytoUniformBuffer(uos);
+        uniformOffscreen.copytoUniformBuffer(batch, uos);
     }
 };
\ No newline at end of file
@@ -17,48 +17,44 @@ class IrPipeline
     {
         VkVertexInputBindingDescription bindingDescription{};
         bindingDescription.binding = 0;
-        bindingDescription.stride = sizeof(Vertex);
+        bindingDescription.stride = sizeof(IrPackedVertex);
         bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
         return bindingDescription;
     }
 
-    std::array<VkVertexInputAttributeDescription, 5> getAttributeDescriptions()
+    // Location 3 (the constant vertex color) is gone; flags keep location 4.
+    std::array<VkVertexInputAttributeDescription, 4> getAttributeDescriptions()
     {
-        std::array<VkVertexInputAttributeDescription, 5> attributeDescriptions{};
+        std::array<VkVertexInputAttributeDescription, 4> attributeDescriptions{};
 
         attributeDescriptions[0].binding = 0;
         attributeDescriptions[0].location = 0;
         attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attributeDescriptions[0].offset = offsetof(Vertex, pos);
+        attributeDescriptions[0].offset = offsetof(IrPackedVertex, pos);
 
         attributeDescriptions[1].binding = 0;
         attributeDescriptions[1].location = 1;
-        attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attributeDescriptions[1].offset = offsetof(Vertex, normal);
+        attributeDescriptions[1].format = VK_FORMAT_R16G16_SNORM;
+        attributeDescriptions[1].offset = offsetof(IrPackedVertex, normal);
 
         attributeDescriptions[2].binding = 0;
         attributeDescriptions[2].location = 2;
-        attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-        attributeDescriptions[2].offset = offsetof(Vertex, uv);
+        attributeDescriptions[2].format = VK_FORMAT_R16G16_SFLOAT;
+        attributeDescriptions[2].offset = offsetof(IrPackedVertex, uv);
 
         attributeDescriptions[3].binding = 0;
-        attributeDescriptions[3].location = 3;
-        attributeDescriptions[3].format = VK_FORMAT_R32G32_SFLOAT;
-        attributeDescriptions[3].offset = offsetof(Vertex, color);
-
-        attributeDescriptions[4].binding = 0;
-        attributeDescriptions[4].location = 4;
-        attributeDescriptions[4].format = VK_FORMAT_R32_UINT;
-        attributeDescriptions[4].offset = offsetof(Vertex, flags);
+        attributeDescriptions[3].location = 4;
+        attributeDescriptions[3].format = VK_FORMAT_R32_UINT;
+        attributeDescriptions[3].offset = offsetof(IrPackedVertex, flags);
 
         return attributeDescriptions;
     }
 
     void createGraphicsPipeline(VkRenderPass renderPass, IrShadowRenderDescriptor &shadowRenderDescriptor)
     {
-        auto vertShaderCode = readFile("G:/glsl/mesh.vert.spv");
-        auto fragShaderCode = readFile("G:/glsl/mesh.frag.spv");
+        auto vertShaderCode = readFile(IR_SHADER_DIR "mesh.vert.spv");
+        auto fragShaderCode = readFile(IR_SHADER_DIR "mesh.frag.spv");
 
         VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
         VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
@@ -193,7 +189,7 @@ class IrOffscreenPipeline : public IrPipeline
       {
           VkVertexInputBindingDescription bindingDescription{};
           bindingDescription.binding = 0;
-          bindingDescription.stride = sizeof(Vertex);
+          bindingDescription.stride = sizeof(glm::vec3); // the position stream
           bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
           return bindingDescription;
@@ -206,14 +202,14 @@ class IrOffscreenPipeline : public IrPipeline
           attributeDescriptions[0].binding = 0;
           attributeDescriptions[0].location = 0;
           attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-          attributeDescriptions[0].offset = offsetof(Vertex, pos);
+          attributeDescriptions[0].offset = 0;
 
 
           return attributeDescriptions;
       }
     void createGraphicsPipeline(VkRenderPass renderPass, IrShadowDescriptor &shadowDescriptor)
     {
-        auto vertShaderCode = readFile("G:/glsl/depth.vert.spv");
+        auto vertShaderCode = readFile(IR_SHADER_DIR "depth.vert.spv");
 
         VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
 
@@ -328,8 +324,8 @@ class IrDebugPipeline : public IrPipeline
   public:
     void createGraphicsPipeline(VkRenderPass &renderPass, IrDebugDescriptor& debugDescriptor)
     {
-        auto vertShaderCode = readFile("G:/glsl/debug.vert.spv");
-        auto fragShaderCode = readFile("G:/glsl/debug.frag.spv");
+        auto vertShaderCode = readFile(IR_SHADER_DIR "debug.vert.spv");
+        auto fragShaderCode = readFile(IR_SHADER_DIR "debug.frag.spv");
 
         VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
         VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
@@ -455,52 +451,76 @@ class IrShadowRenderPipeline
     VkPipelineLayout pipelineLayout;
     VkPipeline shadowPipeline;
     VkPipeline shadowPCFPipeline;
+
+    // Variant for the indirect path: set 1 holds the texture array and the per-draw material SSBO.
+    VkPipelineLayout indirectPipelineLayout;
+    VkPipeline indirectPipeline;
+    VkPipeline indirectPCFPipeline;
+
     VkVertexInputBindingDescription getBindingDescription()
     {
         VkVertexInputBindingDescription bindingDescription{};
         bindingDescription.binding = 0;
-        bindingDescription.stride = sizeof(Vertex);
+        bindingDescription.stride = sizeof(IrPackedVertex);
         bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
         return bindingDescription;
     }
 
-    std::array<VkVertexInputAttributeDescription, 5> getAttributeDescriptions()
+    // Location 3 (the constant vertex color) is gone; flags keep location 4.
+    std::array<VkVertexInputAttributeDescription, 4> getAttributeDescriptions()
     {
-        std::array<VkVertexInputAttributeDescription, 5> attributeDescriptions{};
+        std::array<VkVertexInputAttributeDescription, 4> attributeDescriptions{};
 
         attributeDescriptions[0].binding = 0;
         attributeDescriptions[0].location = 0;
         attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attributeDescriptions[0].offset = offsetof(Vertex, pos);
+        attributeDescriptions[0].offset = offsetof(IrPackedVertex, pos);
 
         attributeDescriptions[1].binding = 0;
         attributeDescriptions[1].location = 1;
-        attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attributeDescriptions[1].offset = offsetof(Vertex, normal);
+        attributeDescriptions[1].format = VK_FORMAT_R16G16_SNORM;
+        attributeDescriptions[1].offset = offsetof(IrPackedVertex, normal);
 
         attributeDescriptions[2].binding = 0;
         attributeDescriptions[2].location = 2;
-        attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-        attributeDescriptions[2].offset = offsetof(Vertex, uv);
+        attributeDescriptions[2].format = VK_FORMAT_R16G16_SFLOAT;
+        attributeDescriptions[2].offset = offsetof(IrPackedVertex, uv);
 
         attributeDescriptions[3].binding = 0;
-        attributeDescriptions[3].location = 3;
-        attributeDescriptions[3].format = VK_FORMAT_R32G32_SFLOAT;
-        attributeDescriptions[3].offset = offsetof(Vertex, color);
-
-        attributeDescriptions[4].binding = 0;
-        attributeDescriptions[4].location = 4;
-        attributeDescriptions[4].format = VK_FORMAT_R32_UINT;
-        attributeDescriptions[4].offset = offsetof(Vertex, flags);
+        attributeDescriptions[3].location = 4;
+        attributeDescriptions[3].format = VK_FORMAT_R32_UINT;
+        attributeDescriptions[3].offset = offsetof(IrPackedVertex, flags);
 
         return attributeDescriptions;
     }
 
     void createGraphicsPipeline(VkRenderPass& renderPass, IrShadowRenderDescriptor& shadowRenderDescriptor)
     {
-        auto vertShaderCode = readFile("G:/glsl/mesh.vert.spv");
-        auto fragShaderCode = readFile("G:/glsl/mesh.frag.spv");
+        std::vector<VkDescriptorSetLayout> setLayouts(shadowRenderDescriptor.shadowRenderDescriptorSetLayout.begin(),
+                                                      shadowRenderDescriptor.shadowRenderDescriptorSetLayout.end());
+        createPipelines(renderPass, setLayouts, IR_SHADER_DIR "mesh.vert.spv", IR_SHADER_DIR "mesh.frag.spv",
+                        pipelineLayout, shadowPipeline, shadowPCFPipeline);
+    }
+
+    // mesh_indirect.vert reads materials[gl_InstanceIndex] from set 1 binding 1 and forwards the texture index;
+    // mesh_indirect.frag samples textures[nonuniformEXT(index)] from set 1 binding 0.
+    void createIndirectGraphicsPipeline(VkRenderPass &renderPass, IrShadowRenderDescriptor &shadowRenderDescriptor,
+                                        IrIndirectDescriptor &indirectDescriptor)
+    {
+        std::vector<VkDescriptorSetLayout> setLayouts = {shadowRenderDescriptor.shadowRenderDescriptorSetLayout[0],
+                                                         indirectDescriptor.indirectDescriptorSetLayout};
+        createPipelines(renderPass, setLayouts, IR_SHADER_DIR "mesh_indirect.vert.spv",
+                        IR_SHADER_DIR "mesh_indirect.frag.spv", indirectPipelineLayout, indirectPipeline,
+                        indirectPCFPipeline);
+    }
+
+    void createPipelines(VkRenderPass &renderPass, std::vector<VkDescriptorSetLayout> &setLayouts,
+                         const std::string &vertPath, const std::string &fragPath, VkPipelineLayout &layout,
+                         VkPipeline &pipeline, VkPipeline &pcfPipeline)
+    {
+        auto vertShaderCode = readFile(vertPath);
+        auto fragShaderCode = readFile(fragPath);
 
         VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
         VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
@@ -591,11 +611,11 @@ class IrShadowRenderPipeline
 
         VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
         pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutInfo.setLayoutCount = shadowRenderDescriptor.shadowRenderDescriptorSetLayout.size();
-        pipelineLayoutInfo.pSetLayouts = shadowRenderDescriptor.shadowRenderDescriptorSetLayout.data();
+        pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+        pipelineLayoutInfo.pSetLayouts = setLayouts.data();
         pipelineLayoutInfo.pushConstantRangeCount = 0;
 
-        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &layout) != VK_SUCCESS)
         {
             throw std::runtime_error("failed to create pipeline layout!");
         }
@@ -612,7 +632,7 @@ class IrShadowRenderPipeline
         pipelineInfo.pDepthStencilState = &depthStencil;
         pipelineInfo.pColorBlendState = &colorBlending;
         pipelineInfo.pDynamicState = &dynamicState;
-        pipelineInfo.layout = pipelineLayout;
+        pipelineInfo.layout = layout;
         pipelineInfo.renderPass = renderPass;
         pipelineInfo.subpass = 0;
         pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
@@ -631,14 +651,14 @@ class IrShadowRenderPipeline
 
         shaderStages[1].pSpecializationInfo = &specializationInfo;
 
-        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &shadowPipeline) != VK_SUCCESS)
+        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
         {
             throw std::runtime_error("failed to create graphics pipeline!");
         }
 
         enablePCF = 1;
 
-        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &shadowPCFPipeline) !=
+        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pcfPipeline) !=
             VK_SUCCESS)
         {
             throw std::runtime_error("failed to create graphics pipeline!");
@@ -647,4 +667,100 @@ class IrShadowRenderPipeline
         vkDestroyShaderModule(device, fragShaderModule, nullptr);
         vkDestroyShaderModule(device, vertShaderModule, nullptr);
     }
-};
\ No newline at end of file
+};
+
+// Builds a single-set compute pipeline whose push constant block is pushConstantSize bytes (0 for none).
+inline void createComputePipelineFromFile(const std::string &path, VkDescriptorSetLayout setLayout,
+                                          uint32_t pushConstantSize, VkPipelineLayout &pipelineLayout,
+                                          VkPipeline &computePipeline)
+{
+    auto compShaderCode = readFile(path);
+
+    VkShaderModule compShaderModule = createShaderModule(compShaderCode);
+
+    VkPipelineShaderStageCreateInfo compShaderStageInfo{};
+    compShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    compShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    compShaderStageInfo.module = compShaderModule;
+    compShaderStageInfo.pName = "main";
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = pushConstantSize;
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = (pushConstantSize > 0) ? 1 : 0;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = compShaderStageInfo;
+    pipelineInfo.layout = pipelineLayout;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+    if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &computePipeline) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create compute pipeline!");
+    }
+
+    vkDestroyShaderModule(device, compShaderModule, nullptr);
+}
+
+class IrCullPipeline
+{
+  public:
+    VkPipelineLayout pipelineLayout;
+    VkPipeline computePipeline;
+
+    // cull_occlusion.comp additionally takes a uint phase push constant: 0 culls against the frustums and last
+    // frame's visibility, 1 re-tests the main pass against this frame's depth pyramid.
+    void createComputePipeline(IrCullDescriptor &cullDescriptor, bool occlusion)
+    {
+        const char *path = occlusion ? IR_SHADER_DIR "cull_occlusion.comp.spv" : IR_SHADER_DIR "cull.comp.spv";
+        createComputePipelineFromFile(path, cullDescriptor.cullDescriptorSetLayout,
+                                      occlusion ? sizeof(uint32_t) : 0, pipelineLayout, computePipeline);
+    }
+};
+
+// cluster_cull.comp runs one invocation per meshlet of the cull descriptor set's binding 7: it tests the bounding
+// sphere against cameraPlanes and the normal cone against cameraPosition. Each survivor appends a command with
+// firstInstance = drawIndex to binding 8, counted in counts[3]. cluster_cull_occlusion.comp additionally skips
+// meshlets whose draw's visibility was cleared last frame.
+class IrClusterCullPipeline
+{
+  public:
+    VkPipelineLayout pipelineLayout;
+    VkPipeline computePipeline;
+
+    void createComputePipeline(IrCullDescriptor &cullDescriptor, bool occlusion)
+    {
+        const char *path =
+            occlusion ? IR_SHADER_DIR "cluster_cull_occlusion.comp.spv" : IR_SHADER_DIR "cluster_cull.comp.spv";
+        createComputePipelineFromFile(path, cullDescriptor.cullDescriptorSetLayout, 0, pipelineLayout,
+                                      computePipeline);
+    }
+};
+
+// depthreduce.comp writes one pyramid level per dispatch; the push constant is the level size as a vec2.
+class IrDepthReducePipeline
+{
+  public:
+    VkPipelineLayout pipelineLayout;
+    VkPipeline computePipeline;
+
+    void createComputePipeline(IrDepthReduceDescriptor &depthReduceDescriptor)
+    {
+        createComputePipelineFromFile(IR_SHADER_DIR "depthreduce.comp.spv",
+                                      depthReduceDescriptor.depthReduceDescriptorSetLayout, sizeof(glm::vec2),
+                                      pipelineLayout, computePipeline);
+    }
+};
@@ -0,0 +1,159 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "irjobsystem.h"
+#include "resourceManager.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+// One render pass instance whose draws are recorded into secondary command buffers. recordRange is called
+// from job system threads with a fresh secondary buffer and a [first, first + count) slice of itemCount; it must
+// set all state it needs, since secondaries inherit none. commandBuffers receives the recorded buffers in
+// item order, ready for vkCmdExecuteCommands inside a VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS pass.
+struct IrSecondaryPass
+{
+    VkRenderPass renderPass;
+    VkFramebuffer framebuffer;
+    uint32_t itemCount;
+    std::function<void(VkCommandBuffer, uint32_t, uint32_t)> recordRange;
+    std::vector<VkCommandBuffer> commandBuffers;
+};
+
+// Records the secondary command buffers of several passes in parallel on the engine's job system. Each job system
+// thread owns one command pool per frame in flight, so no pool is ever touched by two threads, and a frame's pools
+// are reset as a whole once the timeline says the frame's previous submission has retired.
+class IrSecondaryRecorder
+{
+  public:
+    uint32_t minItemsPerRange = 256; // below this a range is not worth its own secondary buffer
+
+    void createSecondaryRecorder(uint32_t queueFamilyIndex, IrJobSystem &jobs)
+    {
+        jobSystem = &jobs;
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = queueFamilyIndex;
+
+        for (uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++)
+        {
+            workers[frame].resize(jobSystem->threadCount());
+            for (Worker &worker : workers[frame])
+            {
+                if (vkCreateCommandPool(device, &poolInfo, nullptr, &worker.commandPool) != VK_SUCCESS)
+                {
+                    throw std::runtime_error("failed to create worker command pool!");
+                }
+            }
+        }
+    }
+
+    void destroySecondaryRecorder()
+    {
+        for (uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++)
+        {
+            for (Worker &worker : workers[frame])
+            {
+                vkDestroyCommandPool(device, worker.commandPool, nullptr);
+            }
+            workers[frame].clear();
+        }
+    }
+
+    // Only valid once the frame's previous submission has completed.
+    void beginFrame(uint32_t frame)
+    {
+        for (Worker &worker : workers[frame])
+        {
+            vkResetCommandPool(device, worker.commandPool, 0);
+            worker.used = 0;
+        }
+    }
+
+    // Splits every pass into ranges, records all ranges of all passes as jobs and returns once they are done. Must
+    // be called from the main thread, which records into the pools of the job system's outside-thread slot.
+    void record(uint32_t frame, const std::vector<IrSecondaryPass *> &passes)
+    {
+        uint32_t threads = jobSystem->threadCount();
+        std::vector<IrJobHandle> jobs;
+        for (IrSecondaryPass *pass : passes)
+        {
+            uint32_t rangeSize = std::max(minItemsPerRange, (pass->itemCount + threads - 1) / threads);
+            uint32_t ranges = std::max(1u, (pass->itemCount + rangeSize - 1) / rangeSize);
+            pass->commandBuffers.assign(ranges, VK_NULL_HANDLE);
+            for (uint32_t r = 0; r < ranges; r++)
+            {
+                uint32_t first = r * rangeSize;
+                uint32_t count = std::min(rangeSize, pass->itemCount - std::min(first, pass->itemCount));
+                jobs.push_back(jobSystem->schedule([this, frame, pass, r, first, count]() {
+                    recordRange(workers[frame][jobSystem->threadIndex()], *pass, r, first, count);
+                }));
+            }
+        }
+        jobSystem->wait(jobs);
+    }
+
+  private:
+    struct Worker
+    {
+        VkCommandPool commandPool;
+        std::vector<VkCommandBuffer> commandBuffers; // allocated on demand, reused after the pool reset
+        uint32_t used = 0;
+    };
+
+    IrJobSystem *jobSystem = nullptr;
+    std::array<std::vector<Worker>, MAX_FRAMES_IN_FLIGHT> workers;
+
+    static void recordRange(Worker &worker, IrSecondaryPass &pass, uint32_t range, uint32_t first, uint32_t count)
+    {
+        if (worker.used == worker.commandBuffers.size())
+        {
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = worker.commandPool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            allocInfo.commandBufferCount = 1;
+
+            VkCommandBuffer commandBuffer;
+            if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to allocate secondary command buffer!");
+            }
+            worker.commandBuffers.push_back(commandBuffer);
+        }
+        VkCommandBuffer commandBuffer = worker.commandBuffers[worker.used++];
+
+        VkCommandBufferInheritanceInfo inheritanceInfo{};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.renderPass = pass.renderPass;
+        inheritanceInfo.subpass = 0;
+        inheritanceInfo.framebuffer = pass.framebuffer;
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags =
+            VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to begin recording command buffer!");
+        }
+
+        pass.recordRange(commandBuffer, first, count);
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to record command buffer!");
+        }
+
+        pass.commandBuffers[range] = commandBuffer;
+    }
+};
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IR_SIMD_SSE2
+#endif
+
+// Lane helpers for the CPU occlusion rasterizer and the model loader: AVX2 when the compiler targets it, SSE2 on
+// any other x86-64 build, scalar elsewhere. Masks are all-ones/all-zeros lanes as the compare instructions
+// produce them.
+namespace irsimd
+{
+#if defined(__AVX2__)
+using Float = __m256;
+constexpr int width = 8;
+inline Float set1(float v)
+{
+    return _mm256_set1_ps(v);
+}
+inline Float ramp()
+{
+    return _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+}
+inline Float load(const float *p)
+{
+    return _mm256_loadu_ps(p);
+}
+inline void store(float *p, Float v)
+{
+    _mm256_storeu_ps(p, v);
+}
+inline Float add(Float a, Float b)
+{
+    return _mm256_add_ps(a, b);
+}
+inline Float mul(Float a, Float b)
+{
+    return _mm256_mul_ps(a, b);
+}
+inline Float min(Float a, Float b)
+{
+    return _mm256_min_ps(a, b);
+}
+inline Float max(Float a, Float b)
+{
+    return _mm256_max_ps(a, b);
+}
+inline Float sub(Float a, Float b)
+{
+    return _mm256_sub_ps(a, b);
+}
+inline Float div(Float a, Float b)
+{
+    return _mm256_div_ps(a, b);
+}
+inline Float sqrt(Float a)
+{
+    return _mm256_sqrt_ps(a);
+}
+inline Float cmpGe(Float a, Float b)
+{
+    return _mm256_cmp_ps(a, b, _CMP_GE_OQ);
+}
+inline Float cmpLe(Float a, Float b)
+{
+    return _mm256_cmp_ps(a, b, _CMP_LE_OQ);
+}
+inline Float maskAnd(Float a, Float b)
+{
+    return _mm256_and_ps(a, b);
+}
+inline Float select(Float mask, Float a, Float b)
+{
+    return _mm256_blendv_ps(b, a, mask);
+}
+inline bool any(Float mask)
+{
+    return _mm256_movemask_ps(mask) != 0;
+}
+#elif defined(IR_SIMD_SSE2)
+using Float = __m128;
+constexpr int width = 4;
+inline Float set1(float v)
+{
+    return _mm_set1_ps(v);
+}
+inline Float ramp()
+{
+    return _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+}
+inline Float load(const float *p)
+{
+    return _mm_loadu_ps(p);
+}
+inline void store(float *p, Float v)
+{
+    _mm_storeu_ps(p, v);
+}
+inline Float add(Float a, Float b)
+{
+    return _mm_add_ps(a, b);
+}
+inline Float mul(Float a, Float b)
+{
+    return _mm_mul_ps(a, b);
+}
+inline Float min(Float a, Float b)
+{
+    return _mm_min_ps(a, b);
+}
+inline Float max(Float a, Float b)
+{
+    return _mm_max_ps(a, b);
+}
+inline Float sub(Float a, Float b)
+{
+    return _mm_sub_ps(a, b);
+}
+inline Float div(Float a, Float b)
+{
+    return _mm_div_ps(a, b);
+}
+inline Float sqrt(Float a)
+{
+    return _mm_sqrt_ps(a);
+}
+inline Float cmpGe(Float a, Float b)
+{
+    return _mm_cmpge_ps(a, b);
+}
+inline Float cmpLe(Float a, Float b)
+{
+    return _mm_cmple_ps(a, b);
+}
+inline Float maskAnd(Float a, Float b)
+{
+    return _mm_and_ps(a, b);
+}
+inline Float select(Float mask, Float a, Float b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+inline bool any(Float mask)
+{
+    return _mm_movemask_ps(mask) != 0;
+}
+#else
+using Float = float;
+constexpr int width = 1;
+inline Float set1(float v)
+{
+    return v;
+}
+inline Float ramp()
+{
+    return 0.0f;
+}
+inline Float load(const float *p)
+{
+    return *p;
+}
+inline void store(float *p, Float v)
+{
+    *p = v;
+}
+inline Float add(Float a, Float b)
+{
+    return a + b;
+}
+inline Float mul(Float a, Float b)
+{
+    return a * b;
+}
+inline Float min(Float a, Float b)
+{
+    return std::min(a, b);
+}
+inline Float max(Float a, Float b)
+{
+    return std::max(a, b);
+}
+inline Float sub(Float a, Float b)
+{
+    return a - b;
+}
+inline Float div(Float a, Float b)
+{
+    return a / b;
+}
+inline Float sqrt(Float a)
+{
+    return std::sqrt(a);
+}
+inline Float cmpGe(Float a, Float b)
+{
+    return (a >= b) ? 1.0f : 0.0f;
+}
+inline Float cmpLe(Float a, Float b)
+{
+    return (a <= b) ? 1.0f : 0.0f;
+}
+inline Float maskAnd(Float a, Float b)
+{
+    return a * b;
+}
+inline Float select(Float mask, Float a, Float b)
+{
+    return (mask != 0.0f) ? a : b;
+}
+inline bool any(Float mask)
+{
+    return mask != 0.0f;
+}
+#endif
+} // namespace irsimd
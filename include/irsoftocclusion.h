@@ -0,0 +1,258 @@
+#pragma once
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include "geometry.h"
+#include "irsimd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// One candidate for CPU occlusion culling: an index range of the shared vertex/index arrays and its object-space
+// bounds. Meshes are in draw list order, so the visibility results line up with IrDrawList::items.
+struct IrOcclusionMesh
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t vertexOffset;
+    glm::vec3 aabbMin;
+    glm::vec3 aabbMax;
+};
+
+struct IrOcclusionStats
+{
+    uint64_t trianglesRasterized = 0;
+    uint64_t meshesTested = 0;
+    uint64_t meshesCulled = 0;
+};
+
+// Coarse occlusion culling on the CPU, for the light view and for devices without the depth pyramid. Each cull()
+// picks the meshes with the largest screen footprint as occluders, rasterizes their triangles into a small depth
+// buffer and then tests every mesh's projected AABB against it. A mesh is culled only when every covered texel
+// already holds something nearer than the box's nearest corner. Occluders are assumed to be closed, and anything
+// touching the near plane is kept.
+class IrSoftwareOcclusion
+{
+  public:
+    static const int width = 256; // multiple of the widest lane count so row loads never leave the buffer
+    static const int height = 192;
+
+    uint32_t maxOccluders = 32;
+    float minOccluderArea = 0.01f; // fraction of the screen an occluder's bounds must cover
+    IrOcclusionStats stats;
+
+    void setMeshes(std::vector<IrOcclusionMesh> occlusionMeshes)
+    {
+        meshes = std::move(occlusionMeshes);
+        rects.resize(meshes.size());
+    }
+
+    // Writes 1 to visible[i] for meshes that may be visible through mvp and 0 for the occluded ones.
+    void cull(const glm::mat4 &mvp, const std::vector<glm::vec3> &positions, const std::vector<uint16_t> &indices,
+              std::vector<uint8_t> &visible)
+    {
+        depth.assign(width * height, 1.0f);
+        visible.assign(meshes.size(), 1);
+
+        std::vector<std::pair<float, uint32_t>> occluders;
+        for (uint32_t i = 0; i < meshes.size(); i++)
+        {
+            rects[i] = projectBounds(mvp, meshes[i]);
+            float area = std::max(rects[i].x1 - rects[i].x0, 0.0f) * std::max(rects[i].y1 - rects[i].y0, 0.0f) /
+                         (width * height);
+            if (!rects[i].crossesNear && area >= minOccluderArea)
+            {
+                occluders.push_back({area, i});
+            }
+        }
+
+        size_t occluderCount = std::min<size_t>(occluders.size(), maxOccluders);
+        std::partial_sort(occluders.begin(), occluders.begin() + occluderCount, occluders.end(),
+                          [](const auto &a, const auto &b) { return a.first > b.first; });
+
+        for (size_t k = 0; k < occluderCount; k++)
+        {
+            const IrOcclusionMesh &mesh = meshes[occluders[k].second];
+            for (uint32_t t = mesh.firstIndex; t + 2 < mesh.firstIndex + mesh.indexCount; t += 3)
+            {
+                glm::vec4 a = mvp * glm::vec4(positions[indices[t] + mesh.vertexOffset], 1.0f);
+                glm::vec4 b = mvp * glm::vec4(positions[indices[t + 1] + mesh.vertexOffset], 1.0f);
+                glm::vec4 c = mvp * glm::vec4(positions[indices[t + 2] + mesh.vertexOffset], 1.0f);
+                rasterizeTriangle(a, b, c);
+            }
+        }
+
+        for (uint32_t i = 0; i < meshes.size(); i++)
+        {
+            stats.meshesTested++;
+            if (!rects[i].crossesNear && isOccluded(rects[i]))
+            {
+                visible[i] = 0;
+                stats.meshesCulled++;
+            }
+        }
+    }
+
+  private:
+    struct ScreenRect
+    {
+        float x0, y0, x1, y1; // pixel space, clamped to the buffer
+        float nearestZ;
+        bool crossesNear;
+    };
+
+    std::vector<IrOcclusionMesh> meshes;
+    std::vector<ScreenRect> rects;
+    std::vector<float> depth;
+
+    static glm::vec3 toScreen(const glm::vec4 &clip)
+    {
+        float invW = 1.0f / clip.w;
+        return glm::vec3((clip.x * invW * 0.5f + 0.5f) * width, (clip.y * invW * 0.5f + 0.5f) * height,
+                         clip.z * invW);
+    }
+
+    static ScreenRect projectBounds(const glm::mat4 &mvp, const IrOcclusionMesh &mesh)
+    {
+        ScreenRect rect{float(width), float(height), 0.0f, 0.0f, 1.0f, false};
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec3 p((corner & 1) ? mesh.aabbMax.x : mesh.aabbMin.x, (corner & 2) ? mesh.aabbMax.y : mesh.aabbMin.y,
+                        (corner & 4) ? mesh.aabbMax.z : mesh.aabbMin.z);
+            glm::vec4 clip = mvp * glm::vec4(p, 1.0f);
+            if (clip.w <= 0.0f || clip.z < 0.0f)
+            {
+                rect.crossesNear = true;
+                return rect;
+            }
+            glm::vec3 s = toScreen(clip);
+            rect.x0 = std::min(rect.x0, s.x);
+            rect.y0 = std::min(rect.y0, s.y);
+            rect.x1 = std::max(rect.x1, s.x);
+            rect.y1 = std::max(rect.y1, s.y);
+            rect.nearestZ = std::min(rect.nearestZ, s.z);
+        }
+        rect.x0 = std::max(rect.x0, 0.0f);
+        rect.y0 = std::max(rect.y0, 0.0f);
+        rect.x1 = std::min(rect.x1, float(width));
+        rect.y1 = std::min(rect.y1, float(height));
+        return rect;
+    }
+
+    // Pixel centers inside the triangle take the nearer of their stored depth and the interpolated z/w.
+    void rasterizeTriangle(const glm::vec4 &clipA, const glm::vec4 &clipB, const glm::vec4 &clipC)
+    {
+        // Clipping is skipped; dropping a triangle only makes the occluder smaller.
+        if (clipA.w <= 0.0f || clipB.w <= 0.0f || clipC.w <= 0.0f || clipA.z < 0.0f || clipB.z < 0.0f ||
+            clipC.z < 0.0f)
+        {
+            return;
+        }
+
+        glm::vec3 a = toScreen(clipA);
+        glm::vec3 b = toScreen(clipB);
+        glm::vec3 c = toScreen(clipC);
+
+        float area = (c.x - a.x) * (b.y - a.y) - (c.y - a.y) * (b.x - a.x);
+        if (area == 0.0f)
+        {
+            return;
+        }
+        if (area < 0.0f)
+        {
+            std::swap(b, c);
+            area = -area;
+        }
+
+        int minX = std::max(int(std::floor(std::min({a.x, b.x, c.x}))), 0);
+        int minY = std::max(int(std::floor(std::min({a.y, b.y, c.y}))), 0);
+        int maxX = std::min(int(std::ceil(std::max({a.x, b.x, c.x}))), width - 1);
+        int maxY = std::min(int(std::ceil(std::max({a.y, b.y, c.y}))), height - 1);
+        if (minX > maxX || minY > maxY)
+        {
+            return;
+        }
+        stats.trianglesRasterized++;
+
+        // Edge functions E(p) = A * p.x + B * p.y + C, non-negative inside; e0 is opposite a, e1 opposite b.
+        float invArea = 1.0f / area;
+        float a0 = c.y - b.y, b0 = b.x - c.x, c0 = -(a0 * b.x + b0 * b.y);
+        float a1 = a.y - c.y, b1 = c.x - a.x, c1 = -(a1 * c.x + b1 * c.y);
+        float a2 = b.y - a.y, b2 = a.x - b.x, c2 = -(a2 * a.x + b2 * a.y);
+
+        // z is affine in screen space: z = zA * x + zB * y + zC.
+        float zA = (a0 * a.z + a1 * b.z + a2 * c.z) * invArea;
+        float zB = (b0 * a.z + b1 * b.z + b2 * c.z) * invArea;
+        float zC = (c0 * a.z + c1 * b.z + c2 * c.z) * invArea;
+
+        int startX = minX - minX % irsimd::width;
+        const irsimd::Float zero = irsimd::set1(0.0f);
+        const irsimd::Float lastX = irsimd::set1(float(maxX) + 0.5f);
+
+        for (int y = minY; y <= maxY; y++)
+        {
+            float py = float(y) + 0.5f;
+            irsimd::Float rowE0 = irsimd::set1(b0 * py + c0);
+            irsimd::Float rowE1 = irsimd::set1(b1 * py + c1);
+            irsimd::Float rowE2 = irsimd::set1(b2 * py + c2);
+            irsimd::Float rowZ = irsimd::set1(zB * py + zC);
+            float *row = depth.data() + y * width;
+
+            for (int x = startX; x <= maxX; x += irsimd::width)
+            {
+                irsimd::Float px = irsimd::add(irsimd::set1(float(x) + 0.5f), irsimd::ramp());
+                irsimd::Float e0 = irsimd::add(irsimd::mul(irsimd::set1(a0), px), rowE0);
+                irsimd::Float e1 = irsimd::add(irsimd::mul(irsimd::set1(a1), px), rowE1);
+                irsimd::Float e2 = irsimd::add(irsimd::mul(irsimd::set1(a2), px), rowE2);
+
+                irsimd::Float inside = irsimd::maskAnd(irsimd::cmpGe(e0, zero), irsimd::cmpGe(e1, zero));
+                inside = irsimd::maskAnd(inside, irsimd::cmpGe(e2, zero));
+                inside = irsimd::maskAnd(inside, irsimd::cmpLe(px, lastX));
+                if (!irsimd::any(inside))
+                {
+                    continue;
+                }
+
+                irsimd::Float z = irsimd::add(irsimd::mul(irsimd::set1(zA), px), rowZ);
+                irsimd::Float stored = irsimd::load(row + x);
+                irsimd::store(row + x, irsimd::select(inside, irsimd::min(stored, z), stored));
+            }
+        }
+    }
+
+    bool isOccluded(const ScreenRect &rect)
+    {
+        int minX = int(std::floor(rect.x0));
+        int minY = int(std::floor(rect.y0));
+        int maxX = std::min(int(std::ceil(rect.x1)), width) - 1;
+        int maxY = std::min(int(std::ceil(rect.y1)), height) - 1;
+        if (minX > maxX || minY > maxY)
+        {
+            return false; // off screen, left to frustum culling
+        }
+
+        int startX = minX - minX % irsimd::width;
+        const irsimd::Float nearest = irsimd::set1(rect.nearestZ);
+        const irsimd::Float firstX = irsimd::set1(float(minX));
+        const irsimd::Float lastX = irsimd::set1(float(maxX));
+
+        for (int y = minY; y <= maxY; y++)
+        {
+            const float *row = depth.data() + y * width;
+            for (int x = startX; x <= maxX; x += irsimd::width)
+            {
+                irsimd::Float px = irsimd::add(irsimd::set1(float(x)), irsimd::ramp());
+                irsimd::Float lanes = irsimd::maskAnd(irsimd::cmpGe(px, firstX), irsimd::cmpLe(px, lastX));
+                irsimd::Float behind = irsimd::cmpGe(irsimd::load(row + x), nearest);
+                if (irsimd::any(irsimd::maskAnd(lanes, behind)))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+};
@@ -0,0 +1,201 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "resourceManager.h"
+
+#include <cstdint>
+#include <deque>
+#include <stdexcept>
+
+#include "VmaUsage.h"
+
+// A range of the staging ring handed out by a reservation; data is its mapping, at offset in buffer.
+struct IrStagingAllocation
+{
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    uint8_t *data = nullptr;
+};
+
+// One persistently mapped staging buffer shared by every upload, handed out front to back and reused in a
+// circle. The reservations made between two upload submissions form a region tagged with the timeline value
+// the next submission signals (submitValue); the region is reclaimed once the ring's timeline semaphore has
+// reached that value, so its memory is only reused after the copies that read it have executed.
+class IrStagingRing
+{
+  public:
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VmaAllocation all = VK_NULL_HANDLE;
+    uint8_t *mapped = nullptr;
+    VkDeviceSize capacity = 0;
+    VkSemaphore timeline = VK_NULL_HANDLE;
+
+    void createStagingRing(VkDeviceSize size)
+    {
+        capacity = size;
+
+        VkBufferCreateInfo bufCreateInfo = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+        bufCreateInfo.size = size;
+        bufCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+        VmaAllocationCreateInfo allocCreateInfo = {};
+        allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+        allocCreateInfo.flags =
+            VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+        VmaAllocationInfo allocInfo;
+        if (vmaCreateBuffer(allocator, &bufCreateInfo, &allocCreateInfo, &buffer, &all, &allocInfo) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create staging ring!");
+        }
+        mapped = static_cast<uint8_t *>(allocInfo.pMappedData);
+
+        VkSemaphoreTypeCreateInfo typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+
+        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &timeline) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create timeline semaphore!");
+        }
+    }
+
+    void destroyStagingRing()
+    {
+        vkDestroySemaphore(device, timeline, nullptr);
+        vmaDestroyBuffer(allocator, buffer, all);
+        regions.clear();
+        head = tail = 0;
+    }
+
+    // Non-blocking: reclaims what the GPU has finished reading and reserves size bytes at an offset aligned to
+    // alignment (a power of two), or returns false if the ring has no room right now.
+    bool tryReserve(VkDeviceSize size, VkDeviceSize alignment, IrStagingAllocation &allocation)
+    {
+        reclaim();
+
+        // Offsets count up forever; a reservation never straddles the end of the buffer, it skips to the start.
+        uint64_t offset = (head + alignment - 1) & ~(alignment - 1);
+        if (offset % capacity + size > capacity)
+        {
+            offset = (offset / capacity + 1) * capacity;
+        }
+        if (size > capacity || offset + size - tail > capacity)
+        {
+            return false;
+        }
+        head = offset + size;
+
+        uint64_t value = submittedValue + 1;
+        if (!regions.empty() && regions.back().value == value)
+        {
+            regions.back().end = head;
+        }
+        else
+        {
+            regions.push_back({head, value});
+        }
+
+        allocation.buffer = buffer;
+        allocation.offset = offset % capacity;
+        allocation.size = size;
+        allocation.data = mapped + allocation.offset;
+        return true;
+    }
+
+    // Blocking: waits for submitted regions to retire until there is room. Throws when waiting could never
+    // succeed, because size exceeds the ring or only reservations not yet submitted are in the way.
+    IrStagingAllocation reserve(VkDeviceSize size, VkDeviceSize alignment = 16)
+    {
+        if (size > capacity)
+        {
+            throw std::runtime_error("upload larger than the staging ring!");
+        }
+
+        IrStagingAllocation allocation;
+        while (!tryReserve(size, alignment, allocation))
+        {
+            if (regions.empty() || regions.front().value > submittedValue)
+            {
+                throw std::runtime_error("staging ring is full of unsubmitted uploads!");
+            }
+            wait(regions.front().value);
+        }
+        return allocation;
+    }
+
+    // Makes the host writes to allocation visible to the device; a no-op on coherent memory.
+    void flush(const IrStagingAllocation &allocation)
+    {
+        vmaFlushAllocation(allocator, all, allocation.offset, allocation.size);
+    }
+
+    // The timeline value the next upload submission must signal. It releases every reservation made so far, so
+    // call it once per submission, after the copies reading those reservations have been recorded.
+    uint64_t submitValue()
+    {
+        return ++submittedValue;
+    }
+
+    uint64_t completedValue()
+    {
+        uint64_t value = 0;
+        vkGetSemaphoreCounterValue(device, timeline, &value);
+        return value;
+    }
+
+    // Blocks until the submission that signaled value has executed.
+    void wait(uint64_t value)
+    {
+        if (value == 0 || completedValue() >= value)
+        {
+            return;
+        }
+
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &timeline;
+        waitInfo.pValues = &value;
+
+        if (vkWaitSemaphores(device, &waitInfo, UINT64_MAX) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to wait for timeline semaphore!");
+        }
+    }
+
+  private:
+    struct Region
+    {
+        uint64_t end; // ring offset one past the region
+        uint64_t value;
+    };
+
+    std::deque<Region> regions; // oldest first
+    uint64_t head = 0;          // next free ring offset; the buffer position is offset % capacity
+    uint64_t tail = 0;          // start of the oldest region still in use
+    uint64_t submittedValue = 0;
+
+    void reclaim()
+    {
+        if (regions.empty())
+        {
+            return;
+        }
+        uint64_t completed = completedValue();
+        while (!regions.empty() && regions.front().value <= completed)
+        {
+            tail = regions.front().end;
+            regions.pop_front();
+        }
+    }
+};
+
+inline IrStagingRing stagingRing;
@@ -0,0 +1,411 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "irstagingring.h"
+#include "resourceManager.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <vector>
+
+// Collects uploads into one command buffer: buffer copies, image copies and whatever layout transitions and
+// barriers the caller records through commands(). submit() sends everything recorded so far in one submission,
+// which signals the staging ring's timeline, and returns without waiting; landedValue() tells which submissions
+// graphics work can use by now, and flush() waits for all of them.
+//
+// Source data is copied into the staging ring when the upload is recorded, so it may be freed right after. If
+// the ring fills up with the batch's own staging, the recorded part is submitted early to make room. The ring
+// tags its reservations with the next submission, so only one batch may record at a time.
+//
+// With a dedicated transfer queue the copies run there. Each submission then ends by releasing the buffers and
+// images it wrote to the graphics family, and a small graphics submission acquires them, so everything submitted
+// to the graphics queue afterwards sees the data. The acquire is only submitted by landedValue() once the transfer
+// has completed: its barrier holds back all later graphics work, which would otherwise wait for the copies. Nothing
+// hands a resource back to the transfer family, so each buffer and image is uploaded once. Without a dedicated
+// queue the batch runs on the graphics queue and a memory barrier at the end of each submission is all it needs.
+class IrUploadBatch
+{
+  public:
+    VkDeviceSize uploadedBytes = 0;
+    uint32_t submissions = 0;
+    VkSemaphore acquireTimeline = VK_NULL_HANDLE; // signaled by the acquire submissions, dedicated queue only
+
+    // Call after createCommandPool.
+    void createUploadBatch()
+    {
+        if (!dedicatedTransferQueue)
+        {
+            return;
+        }
+
+        VkSemaphoreTypeCreateInfo typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+
+        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &acquireTimeline) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create timeline semaphore!");
+        }
+    }
+
+    void destroyUploadBatch()
+    {
+        flush();
+        if (acquireTimeline != VK_NULL_HANDLE)
+        {
+            vkDestroySemaphore(device, acquireTimeline, nullptr);
+            acquireTimeline = VK_NULL_HANDLE;
+        }
+    }
+
+    // The command buffer being recorded, begun on first use. It runs on transferQueue.
+    VkCommandBuffer commands()
+    {
+        if (commandBuffer == VK_NULL_HANDLE)
+        {
+            releaseFinished();
+            commandBuffer = beginCommands(transferCommandPool);
+        }
+        return commandBuffer;
+    }
+
+    // Copies data into a fresh staging range, submitting the recorded part of the batch first if the ring has
+    // no room until it executes.
+    IrStagingAllocation stage(const void *data, VkDeviceSize size, VkDeviceSize alignment)
+    {
+        IrStagingAllocation staging;
+        if (!stagingRing.tryReserve(size, alignment, staging))
+        {
+            if (commandBuffer != VK_NULL_HANDLE)
+            {
+                submit();
+            }
+            staging = stagingRing.reserve(size, alignment);
+        }
+        memcpy(staging.data, data, size);
+        stagingRing.flush(staging);
+        return staging;
+    }
+
+    // Copies size bytes to dstOffset of dst, in pieces of at most half the ring so a piece always fits while the
+    // previous one is still in flight. dst needs TRANSFER_DST usage.
+    void copyToBuffer(VkBuffer dst, const void *data, VkDeviceSize size, VkDeviceSize dstOffset = 0)
+    {
+        const VkDeviceSize pieceSize = stagingRing.capacity / 2;
+        for (VkDeviceSize done = 0; done < size; done += pieceSize)
+        {
+            VkDeviceSize n = std::min(pieceSize, size - done);
+            IrStagingAllocation staging = stage(static_cast<const uint8_t *>(data) + done, n, 16);
+
+            VkBufferCopy copyRegion = {};
+            copyRegion.srcOffset = staging.offset;
+            copyRegion.dstOffset = dstOffset + done;
+            copyRegion.size = n;
+            vkCmdCopyBuffer(commands(), staging.buffer, dst, 1, &copyRegion);
+        }
+        uploadedBytes += size;
+
+        // Released only after its last piece, so a submission forced by a full ring never hands over half a buffer.
+        if (dedicatedTransferQueue &&
+            std::none_of(bufferTransfers.begin(), bufferTransfers.end(),
+                         [dst](const VkBufferMemoryBarrier &barrier) { return barrier.buffer == dst; }))
+        {
+            VkBufferMemoryBarrier bufMemBarrier = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
+            bufMemBarrier.srcQueueFamilyIndex = transferQueueFamily;
+            bufMemBarrier.dstQueueFamilyIndex = graphicsQueueFamily;
+            bufMemBarrier.buffer = dst;
+            bufMemBarrier.offset = 0;
+            bufMemBarrier.size = VK_WHOLE_SIZE;
+            bufferTransfers.push_back(bufMemBarrier);
+        }
+    }
+
+    // Fills mip 0 of a freshly created RGBA8 image with width * height texels and leaves it in
+    // SHADER_READ_ONLY_OPTIMAL. Staged in bands of whole rows, at most half the ring each, so any size fits.
+    void copyToImage(VkImage image, const uint8_t *pixels, uint32_t width, uint32_t height)
+    {
+        const VkDeviceSize rowSize = VkDeviceSize(width) * 4;
+        const uint32_t bandRows =
+            static_cast<uint32_t>(std::max<VkDeviceSize>(stagingRing.capacity / 2 / rowSize, 1));
+
+        VkImageMemoryBarrier imgMemBarrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+        imgMemBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imgMemBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imgMemBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        imgMemBarrier.subresourceRange.baseMipLevel = 0;
+        imgMemBarrier.subresourceRange.levelCount = 1;
+        imgMemBarrier.subresourceRange.baseArrayLayer = 0;
+        imgMemBarrier.subresourceRange.layerCount = 1;
+        imgMemBarrier.image = image;
+        imgMemBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imgMemBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        imgMemBarrier.srcAccessMask = 0;
+        imgMemBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        vkCmdPipelineBarrier(commands(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+                             nullptr, 0, nullptr, 1, &imgMemBarrier);
+
+        for (uint32_t y = 0; y < height; y += bandRows)
+        {
+            uint32_t rows = std::min(bandRows, height - y);
+            IrStagingAllocation staging = stage(pixels + y * rowSize, rows * rowSize, 4);
+
+            VkBufferImageCopy region = {};
+            region.bufferOffset = staging.offset;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.layerCount = 1;
+            region.imageOffset.y = static_cast<int32_t>(y);
+            region.imageExtent.width = width;
+            region.imageExtent.height = rows;
+            region.imageExtent.depth = 1;
+
+            vkCmdCopyBufferToImage(commands(), staging.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                                   &region);
+        }
+        uploadedBytes += rowSize * height;
+
+        imgMemBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        imgMemBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        if (dedicatedTransferQueue)
+        {
+            // The layout transition happens as part of the ownership transfer, recorded at submit.
+            imgMemBarrier.srcQueueFamilyIndex = transferQueueFamily;
+            imgMemBarrier.dstQueueFamilyIndex = graphicsQueueFamily;
+            imageTransfers.push_back(imgMemBarrier);
+            return;
+        }
+
+        imgMemBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        imgMemBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commands(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
+                             nullptr, 0, nullptr, 1, &imgMemBarrier);
+    }
+
+    // Submits what has been recorded and returns the staging ring timeline value that signals its copies have
+    // completed (or that of the last submission when nothing was recorded). Does not wait.
+    uint64_t submit()
+    {
+        if (commandBuffer == VK_NULL_HANDLE)
+        {
+            return lastValue;
+        }
+
+        uint64_t signalValue = stagingRing.submitValue();
+        if (dedicatedTransferQueue)
+        {
+            submitWithOwnershipTransfer(signalValue);
+        }
+        else
+        {
+            // One barrier makes every transfer write visible to whatever reads it later on the queue.
+            VkMemoryBarrier uploadBarrier = {VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+            uploadBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            uploadBarrier.dstAccessMask = readAccess;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+                                 1, &uploadBarrier, 0, nullptr, 0, nullptr);
+            vkEndCommandBuffer(commandBuffer);
+
+            submitTo(graphicsQueue, commandBuffer, VK_NULL_HANDLE, 0, stagingRing.timeline, signalValue);
+            inFlight.push_back({commandBuffer, VK_NULL_HANDLE, signalValue});
+        }
+
+        commandBuffer = VK_NULL_HANDLE;
+        lastValue = signalValue;
+        submissions++;
+        return signalValue;
+    }
+
+    // Non-blocking: submits the acquire of every transfer that has completed, and returns the value of the newest
+    // submission whose uploads graphics work submitted from now on may use (0 if none). Call it regularly, e.g. once
+    // a frame, while a dedicated transfer queue has uploads in flight.
+    uint64_t landedValue()
+    {
+        if (!dedicatedTransferQueue)
+        {
+            return stagingRing.completedValue();
+        }
+
+        uint64_t transferred = stagingRing.completedValue();
+        while (!unacquired.empty() && unacquired.front().value <= transferred)
+        {
+            // Still waits on the transfer's value, so the acquire is ordered after the release on the device.
+            Submission &submission = unacquired.front();
+            submitTo(graphicsQueue, submission.acquire, stagingRing.timeline, submission.value, acquireTimeline,
+                     submission.value);
+            landed = submission.value;
+            inFlight.push_back(submission);
+            unacquired.pop_front();
+        }
+        return landed;
+    }
+
+    // Submits and waits until everything this batch ever submitted has executed.
+    void flush()
+    {
+        uint64_t value = submit();
+        stagingRing.wait(value);
+        landedValue();
+        if (dedicatedTransferQueue)
+        {
+            waitTimeline(acquireTimeline, value);
+        }
+        releaseFinished();
+    }
+
+  private:
+    static const VkAccessFlags readAccess = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+                                            VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT |
+                                            VK_ACCESS_SHADER_READ_BIT;
+
+    struct Submission
+    {
+        VkCommandBuffer transfer; // from transferCommandPool
+        VkCommandBuffer acquire;  // from commandPool, or VK_NULL_HANDLE
+        uint64_t value;
+    };
+
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    std::vector<VkBufferMemoryBarrier> bufferTransfers; // written since the last submission, still to release
+    std::vector<VkImageMemoryBarrier> imageTransfers;
+    std::deque<Submission> unacquired; // transfer submitted, acquire recorded but not yet submitted; oldest first
+    std::deque<Submission> inFlight;   // fully submitted, oldest first
+    uint64_t lastValue = 0;
+    uint64_t landed = 0;
+
+    static uint64_t counterValue(VkSemaphore timeline)
+    {
+        uint64_t value = 0;
+        vkGetSemaphoreCounterValue(device, timeline, &value);
+        return value;
+    }
+
+    static void waitTimeline(VkSemaphore timeline, uint64_t value)
+    {
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &timeline;
+        waitInfo.pValues = &value;
+
+        if (value != 0 && vkWaitSemaphores(device, &waitInfo, UINT64_MAX) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to wait for timeline semaphore!");
+        }
+    }
+
+    static VkCommandBuffer beginCommands(VkCommandPool pool)
+    {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = pool;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer buffer;
+        if (vkAllocateCommandBuffers(device, &allocInfo, &buffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate upload command buffer!");
+        }
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(buffer, &beginInfo);
+        return buffer;
+    }
+
+    // Submits commands to queue, waiting for wait to reach waitValue first when wait is given, and signaling
+    // signal with signalValue.
+    static void submitTo(VkQueue queue, VkCommandBuffer commands, VkSemaphore wait, uint64_t waitValue,
+                         VkSemaphore signal, uint64_t signalValue)
+    {
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.waitSemaphoreValueCount = wait != VK_NULL_HANDLE ? 1 : 0;
+        timelineInfo.pWaitSemaphoreValues = &waitValue;
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.waitSemaphoreCount = timelineInfo.waitSemaphoreValueCount;
+        submitInfo.pWaitSemaphores = &wait;
+        submitInfo.pWaitDstStageMask = &waitStage;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commands;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &signal;
+
+        if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to submit upload batch!");
+        }
+    }
+
+    // Ends the transfer commands with the release half of every pending ownership transfer and submits them to
+    // transferQueue, then records the matching acquire half for landedValue() to submit.
+    void submitWithOwnershipTransfer(uint64_t signalValue)
+    {
+        for (VkBufferMemoryBarrier &barrier : bufferTransfers)
+        {
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = 0;
+        }
+        for (VkImageMemoryBarrier &barrier : imageTransfers)
+        {
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = 0;
+        }
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0,
+                             nullptr, static_cast<uint32_t>(bufferTransfers.size()), bufferTransfers.data(),
+                             static_cast<uint32_t>(imageTransfers.size()), imageTransfers.data());
+        vkEndCommandBuffer(commandBuffer);
+        submitTo(transferQueue, commandBuffer, VK_NULL_HANDLE, 0, stagingRing.timeline, signalValue);
+
+        for (VkBufferMemoryBarrier &barrier : bufferTransfers)
+        {
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = readAccess;
+        }
+        for (VkImageMemoryBarrier &barrier : imageTransfers)
+        {
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        }
+        VkCommandBuffer acquireBuffer = beginCommands(commandPool);
+        vkCmdPipelineBarrier(acquireBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0,
+                             nullptr, static_cast<uint32_t>(bufferTransfers.size()), bufferTransfers.data(),
+                             static_cast<uint32_t>(imageTransfers.size()), imageTransfers.data());
+        vkEndCommandBuffer(acquireBuffer);
+        unacquired.push_back({commandBuffer, acquireBuffer, signalValue});
+
+        bufferTransfers.clear();
+        imageTransfers.clear();
+    }
+
+    void releaseFinished()
+    {
+        uint64_t completed = dedicatedTransferQueue ? counterValue(acquireTimeline) : stagingRing.completedValue();
+        while (!inFlight.empty() && inFlight.front().value <= completed)
+        {
+            vkFreeCommandBuffers(device, transferCommandPool, 1, &inFlight.front().transfer);
+            if (inFlight.front().acquire != VK_NULL_HANDLE)
+            {
+                vkFreeCommandBuffers(device, commandPool, 1, &inFlight.front().acquire);
+            }
+            inFlight.pop_front();
+        }
+    }
+};
@@ -17,46 +17,31 @@
 #include <glm/mat4x4.hpp>
 #include <glm/vec3.hpp>
 
+#include <cstring>
 #include <string>
 
 #include <gl/GL.h>
 
 #include "tglfUsage.h"
+#include <nlohmann/json.hpp>
+#include <stb_image.h>
 
 #define DEFAULT_FENCE_TIMEOUT 60000000000ull
 
 #include "irImage.h"
+#include "iraccessor.h"
+#include "irsimd.h"
+#include "irjobsystem.h"
+#include "irmappedfile.h"
+#include "irmeshlet.h"
+#include "irmeshoptimizer.h"
 #include "resourceManager.h"
 #include "tool.h"
 #include <unordered_map>
 
 
 
-inline void indexBufferInsert32(std::vector<uint32_t>& indices,size_t vertexStart, const uint8_t* indexData, size_t indexCount) {
-
-    const uint32_t* buf = reinterpret_cast<const uint32_t*>(indexData);
-    for (size_t index = 0; index < indexCount; index++) {
-        indices.push_back(static_cast<uint32_t>(buf[index] + vertexStart));
-    }
-
-}
-
-inline void indexBufferInsert16(std::vector<uint32_t>& indices, size_t vertexStart, const uint8_t* indexData, size_t indexCount) {
-    const uint16_t* buf = reinterpret_cast<const uint16_t*>(indexData);
-    for (size_t index = 0; index < indexCount; index++) {
-        indices.push_back(static_cast<uint32_t>(buf[index] + vertexStart));
-    }
-}
-
-inline void indexBufferInsert8(std::vector<uint32_t>& indices, size_t vertexStart, const uint8_t* indexData, size_t indexCount) {
-    const uint8_t* buf = reinterpret_cast<const uint8_t*>(indexData);
-    for (size_t index = 0; index < indexCount; index++) {
-        indices.push_back(static_cast<uint32_t>(buf[index] + vertexStart));
-    }
-}
-
-
-inline glm::mat4 getMatrix(tinygltf::Node &node)
+inline glm::mat4 getMatrix(const tinygltf::Node &node)
 {
     glm::mat4 matrix(1.0f);
 
@@ -80,157 +65,611 @@ inline glm::mat4 getMatrix(tinygltf::Node &node)
     return matrix;
 }
 
-inline void loadMesh(tinygltf::Mesh &mesh, std::vector<Vertex> &vertexs, std::vector<uint32_t> &indices, int &firstIndex, std::unordered_map<int, int> &firstIndexs, tinygltf::Node& node)
+// One primitive of the default scene, placed in the output arrays by the counting pass of loadScene.
+struct IrPrimitiveImport
 {
-    for (size_t k = 0; k < mesh.primitives.size(); k++)
+    const tinygltf::Node *node;
+    const tinygltf::Primitive *primitive;
+    size_t vertexOffset;
+    size_t vertexCount;
+    size_t indexOffset;
+    size_t indexCount;
+    size_t weldedCount; // vertices in use at the front of the range, fewer than vertexCount after weldPrimitive
+    size_t cacheMissesBefore;
+    size_t cacheMissesAfter;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+};
+
+// Vertex counts of one glTF mesh before and after welding, summed over its instances and primitives.
+struct IrWeldStats
+{
+    std::string mesh;
+    size_t vertices = 0;
+    size_t welded = 0;
+};
+
+inline std::vector<IrWeldStats> weldStats; // per glTF mesh, filled by loadScene when weldVertices is set
+
+// Counting pass: walks the nodes in scene order, prefix-summing every primitive's vertex and index offsets exactly
+// as a serial import would. A non-indexed primitive counts one index per vertex; loadPrimitive generates them.
+inline void countNode(const tinygltf::Node &node, std::vector<IrPrimitiveImport> &primitives, size_t &vertexCount,
+                      size_t &indexCount)
+{
+    if (node.mesh != -1)
     {
+        for (const tinygltf::Primitive &primitive : model.meshes[node.mesh].primitives)
+        {
+            IrPrimitiveImport prim{};
+            prim.node = &node;
+            prim.primitive = &primitive;
+            prim.vertexOffset = vertexCount;
+            prim.indexOffset = indexCount;
+            int position = findAttribute(primitive, "POSITION");
+            prim.vertexCount = (position >= 0) ? model.accessors[position].count : 0;
+            prim.weldedCount = prim.vertexCount;
+            prim.indexCount = (primitive.indices >= 0) ? model.accessors[primitive.indices].count : prim.vertexCount;
+
+            vertexCount += prim.vertexCount;
+            indexCount += prim.indexCount;
+            primitives.push_back(prim);
+        }
+    }
 
-        tinygltf::Primitive primitive = mesh.primitives[k];
+    for (int child : node.children)
+    {
+        countNode(model.nodes[child], primitives, vertexCount, indexCount);
+    }
+}
 
-        firstIndexs[primitive.indices] = firstIndex;
+// Transforms n positions and normals in place, one array per component, irsimd::width vertices at a time, and
+// grows boundsMin/boundsMax per lane. n must be a multiple of irsimd::width.
+inline void transformVertexBatch(const glm::mat4 &matrix, const glm::mat3 &normalMatrix, float *const (&pos)[3],
+                                 float *const (&normal)[3], size_t n, irsimd::Float (&boundsMin)[3],
+                                 irsimd::Float (&boundsMax)[3])
+{
+    using namespace irsimd;
+    Float m[4][3];
+    Float nm[3][3];
+    for (int c = 0; c < 3; c++)
+    {
+        for (int r = 0; r < 3; r++)
+        {
+            m[c][r] = set1(matrix[c][r]);
+            nm[c][r] = set1(normalMatrix[c][r]);
+        }
+        m[3][c] = set1(matrix[3][c]);
+    }
+    const Float tiny = set1(1e-30f);
 
-        tinygltf::Accessor indexAccessor = model.accessors[primitive.indices];
-        tinygltf::BufferView indexBufferView = model.bufferViews[indexAccessor.bufferView];
-        tinygltf::Buffer indexBuffer = model.buffers[indexBufferView.buffer];
+    for (size_t i = 0; i < n; i += width)
+    {
+        Float px = load(pos[0] + i);
+        Float py = load(pos[1] + i);
+        Float pz = load(pos[2] + i);
+        for (int r = 0; r < 3; r++)
+        {
+            Float p = add(add(mul(m[0][r], px), mul(m[1][r], py)), add(mul(m[2][r], pz), m[3][r]));
+            store(pos[r] + i, p);
+            boundsMin[r] = min(boundsMin[r], p);
+            boundsMax[r] = max(boundsMax[r], p);
+        }
 
-        const uint8_t *indexData = &indexBuffer.data[indexBufferView.byteOffset + indexAccessor.byteOffset];
-        size_t indexCount = indexAccessor.count;
-        size_t indexLength = indexBufferView.byteLength;
-        firstIndex += indexCount;
-        size_t vertexStart = static_cast<size_t>(vertexs.size());
+        Float nx = load(normal[0] + i);
+        Float ny = load(normal[1] + i);
+        Float nz = load(normal[2] + i);
+        Float t[3];
+        for (int r = 0; r < 3; r++)
+        {
+            t[r] = add(add(mul(nm[0][r], nx), mul(nm[1][r], ny)), mul(nm[2][r], nz));
+        }
+        // Zero-length normals stay zero instead of turning into NaN.
+        Float length = sqrt(max(add(add(mul(t[0], t[0]), mul(t[1], t[1])), mul(t[2], t[2])), tiny));
+        for (int r = 0; r < 3; r++)
+        {
+            store(normal[r] + i, div(t[r], length));
+        }
+    }
+}
 
+// Conversion pass: writes one primitive into its slots of the pre-sized arrays. Touches nothing shared, so
+// primitives are converted in parallel. Reads go through accessor views straight into the loaded buffers.
+inline void loadPrimitive(IrPrimitiveImport &prim, Vertex *vertexs, uint32_t *indices)
+{
+    const tinygltf::Primitive &primitive = *prim.primitive;
 
-        switch (indexAccessor.componentType)
+    uint32_t *indexOut = indices + prim.indexOffset;
+    if (primitive.indices >= 0)
+    {
+        IrAccessorView indexView(model, primitive.indices);
+        for (size_t i = 0; i < prim.indexCount; i++)
+        {
+            indexOut[i] = static_cast<uint32_t>(indexView.readIndex(i) + prim.vertexOffset);
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < prim.indexCount; i++)
         {
-        case 5120: // BYTE
-            indexBufferInsert8(indices, vertexStart, indexData, indexCount);
-            break;
-        case 5121: // UNSIGNED_BYTE
-            indexBufferInsert8(indices, vertexStart, indexData, indexCount);
-            break;
-        case 5122: // SHORT
-            indexBufferInsert16(indices, vertexStart, indexData, indexCount);
-            break;
-        case 5123: // UNSIGNED_SHORT
-            indexBufferInsert16(indices, vertexStart, indexData, indexCount);
-            break;
-        case 5125: // UNSIGNED_INT
-            indexBufferInsert32(indices, vertexStart, indexData, indexCount);
-
-            break;
-        case 5126: // FLOAT
-            indexBufferInsert32(indices, vertexStart, indexData, indexCount);
-
-            break;
-        default:
-            throw std::runtime_error("Unknown glTF component type.");
+            indexOut[i] = static_cast<uint32_t>(i + prim.vertexOffset);
         }
+    }
 
-        //indices.insert(indices.end(), indexData, indexData + indexLength);
+    IrAccessorView positions(model, findAttribute(primitive, "POSITION"));
+    IrAccessorView normals(model, findAttribute(primitive, "NORMAL"));
+    // glTF supports multiple sets, we only load the first one
+    IrAccessorView texCoords(model, findAttribute(primitive, "TEXCOORD_0"));
+
+    glm::mat4 matrix = getMatrix(*prim.node);
+    glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(matrix)));
+    uint32_t flags = (primitive.material == -1) ? 1 : 0;
+
+    // Vertices are decoded a batch at a time into per-component arrays, transformed with SIMD, then written out.
+    // A partial last batch is padded with copies of its first vertex, which leaves the bounds unchanged.
+    const size_t batchSize = 256;
+    static_assert(batchSize % irsimd::width == 0);
+    alignas(32) float batch[8][batchSize];
+    float *const pos[3] = {batch[0], batch[1], batch[2]};
+    float *const normal[3] = {batch[3], batch[4], batch[5]};
+    float *const uv[2] = {batch[6], batch[7]};
+
+    irsimd::Float boundsMin[3];
+    irsimd::Float boundsMax[3];
+    for (int c = 0; c < 3; c++)
+    {
+        boundsMin[c] = irsimd::set1(std::numeric_limits<float>::max());
+        boundsMax[c] = irsimd::set1(std::numeric_limits<float>::lowest());
+    }
 
-        const float *positionBuffer = nullptr;
-        const float *normalsBuffer = nullptr;
-        const float *texCoordsBuffer = nullptr;
+    for (size_t first = 0; first < prim.vertexCount; first += batchSize)
+    {
+        size_t n = std::min(batchSize, prim.vertexCount - first);
+        positions.readComponents(first, n, pos);
+        normals.readComponents(first, n, normal);
+        texCoords.readComponents(first, n, uv);
 
-        size_t vertexCount = 0;
+        size_t padded = (n + irsimd::width - 1) / irsimd::width * irsimd::width;
+        for (size_t k = n; k < padded; k++)
+        {
+            for (float *component : batch)
+            {
+                component[k] = component[0];
+            }
+        }
+        transformVertexBatch(matrix, normalMatrix, pos, normal, padded, boundsMin, boundsMax);
 
-        // Get buffer data for vertex positions
-        if (primitive.attributes.find("POSITION") != primitive.attributes.end())
+        Vertex *out = vertexs + prim.vertexOffset + first;
+        for (size_t k = 0; k < n; k++)
         {
-            const tinygltf::Accessor &accessor = model.accessors[primitive.attributes.find("POSITION")->second];
-            const tinygltf::BufferView &view = model.bufferViews[accessor.bufferView];
-            positionBuffer = reinterpret_cast<const float *>(
-                &(model.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
-            vertexCount = accessor.count;
+            out[k].pos = glm::vec3(pos[0][k], pos[1][k], pos[2][k]);
+            out[k].normal = glm::vec3(normal[0][k], normal[1][k], normal[2][k]);
+            out[k].uv = glm::vec2(uv[0][k], uv[1][k]);
+            out[k].color = glm::vec3(1.0f);
+            out[k].flags = flags;
         }
-        // Get buffer data for vertex normals
-        if (primitive.attributes.find("NORMAL") != primitive.attributes.end())
+    }
+
+    alignas(32) float lanes[irsimd::width];
+    for (int c = 0; c < 3; c++)
+    {
+        irsimd::store(lanes, boundsMin[c]);
+        prim.boundsMin[c] = *std::min_element(lanes, lanes + irsimd::width);
+        irsimd::store(lanes, boundsMax[c]);
+        prim.boundsMax[c] = *std::max_element(lanes, lanes + irsimd::width);
+    }
+}
+
+// Merges identical vertices of one loaded primitive. The unique vertices are packed, in first-use order, at the
+// front of the primitive's vertex range and its indices are remapped to them. The table is open-addressed with
+// linear probing, sized to a power of two at most half full, and stores indices into the packed vertices.
+inline void weldPrimitive(IrPrimitiveImport &prim, Vertex *vertexs, uint32_t *indices)
+{
+    prim.weldedCount = prim.vertexCount;
+    if (prim.vertexCount < 2)
+    {
+        return;
+    }
+
+    const uint32_t empty = std::numeric_limits<uint32_t>::max();
+    size_t capacity = 1;
+    while (capacity < prim.vertexCount * 2)
+    {
+        capacity <<= 1;
+    }
+    std::vector<uint32_t> table(capacity, empty);
+    std::vector<uint32_t> remap(prim.vertexCount);
+    std::hash<Vertex> hasher;
+
+    Vertex *base = vertexs + prim.vertexOffset;
+    uint32_t unique = 0;
+    for (size_t v = 0; v < prim.vertexCount; v++)
+    {
+        size_t slot = hasher(base[v]) & (capacity - 1);
+        while (table[slot] != empty && !(base[table[slot]] == base[v]))
         {
-            const tinygltf::Accessor &accessor = model.accessors[primitive.attributes.find("NORMAL")->second];
-            const tinygltf::BufferView &view = model.bufferViews[accessor.bufferView];
-            normalsBuffer = reinterpret_cast<const float *>(
-                &(model.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
+            slot = (slot + 1) & (capacity - 1);
         }
-        // Get buffer data for vertex texture coordinates
-        // glTF supports multiple sets, we only load the first one
-        if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end())
+        if (table[slot] == empty)
         {
-            const tinygltf::Accessor &accessor = model.accessors[primitive.attributes.find("TEXCOORD_0")->second];
-            const tinygltf::BufferView &view = model.bufferViews[accessor.bufferView];
-            texCoordsBuffer = reinterpret_cast<const float *>(
-                &(model.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
+            base[unique] = base[v]; // unique <= v, so this never overwrites a vertex still to be read
+            table[slot] = unique++;
         }
+        remap[v] = table[slot];
+    }
 
-        for (size_t v = 0; v < vertexCount; v++)
+    uint32_t *indexOut = indices + prim.indexOffset;
+    for (size_t i = 0; i < prim.indexCount; i++)
+    {
+        size_t local = indexOut[i] - prim.vertexOffset;
+        if (local >= prim.vertexCount)
         {
-            Vertex vert{};
-            vert.pos = glm::vec4(glm::make_vec3(&positionBuffer[v * 3]), 1.0f);
+            throw std::runtime_error("glTF index out of range.");
+        }
+        indexOut[i] = static_cast<uint32_t>(prim.vertexOffset + remap[local]);
+    }
+    prim.weldedCount = unique;
+}
 
+// Reorders a loaded (and possibly welded) primitive for the vertex cache, overdraw and vertex fetch, recording
+// the simulated cache misses before and after.
+inline void optimizePrimitive(IrPrimitiveImport &prim, Vertex *vertexs, uint32_t *indices)
+{
+    uint32_t *local = indices + prim.indexOffset;
+    Vertex *base = vertexs + prim.vertexOffset;
+    for (size_t i = 0; i < prim.indexCount; i++)
+    {
+        local[i] -= static_cast<uint32_t>(prim.vertexOffset);
+    }
 
-            vert.pos = getMatrix(node) * glm::vec4(vert.pos, 1.0f);
+    prim.cacheMissesBefore = simulateVertexCache(local, prim.indexCount, prim.weldedCount);
+    optimizeVertexCache(local, prim.indexCount, prim.weldedCount);
+    optimizeOverdraw(local, prim.indexCount, base, prim.weldedCount);
+    optimizeVertexFetch(local, prim.indexCount, base, prim.weldedCount);
+    prim.cacheMissesAfter = simulateVertexCache(local, prim.indexCount, prim.weldedCount);
 
+    for (size_t i = 0; i < prim.indexCount; i++)
+    {
+        local[i] += static_cast<uint32_t>(prim.vertexOffset);
+    }
+}
 
-            if (vert.pos.x < xl) {
-                xl = vert.pos.x;
-            }
-            else if (vert.pos.x > xr) {
-                xr = vert.pos.x;
-            }
+// Closes the gaps welding left between primitives: every primitive's unique vertices move to a new prefix-summed
+// offset and its indices shift with them. Also records the per-mesh statistics.
+inline void packWeldedVertices(std::vector<IrPrimitiveImport> &primitives, std::vector<Vertex> &vertexs,
+                               std::vector<uint32_t> &indices, IrJobSystem &jobSystem)
+{
+    std::vector<size_t> packedOffsets(primitives.size());
+    size_t packedCount = 0;
+    for (size_t i = 0; i < primitives.size(); i++)
+    {
+        packedOffsets[i] = packedCount;
+        packedCount += primitives[i].weldedCount;
+    }
 
-            if (vert.pos.y < yb) {
-                yb = vert.pos.y;
-            }
-            else if (vert.pos.y > yt) {
-                yt = vert.pos.y;
+    std::vector<Vertex> packed(packedCount);
+    jobSystem.parallelFor(static_cast<uint32_t>(primitives.size()), 16, [&](uint32_t first, uint32_t count) {
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            IrPrimitiveImport &prim = primitives[i];
+            std::copy(vertexs.begin() + prim.vertexOffset, vertexs.begin() + prim.vertexOffset + prim.weldedCount,
+                      packed.begin() + packedOffsets[i]);
+            uint32_t shift = static_cast<uint32_t>(prim.vertexOffset - packedOffsets[i]);
+            for (size_t k = prim.indexOffset; k < prim.indexOffset + prim.indexCount; k++)
+            {
+                indices[k] -= shift;
             }
+        }
+    });
+
+    weldStats.assign(model.meshes.size(), IrWeldStats{});
+    size_t totalBefore = 0;
+    for (size_t i = 0; i < primitives.size(); i++)
+    {
+        IrPrimitiveImport &prim = primitives[i];
+        IrWeldStats &stats = weldStats[prim.node->mesh];
+        stats.mesh = model.meshes[prim.node->mesh].name;
+        stats.vertices += prim.vertexCount;
+        stats.welded += prim.weldedCount;
+        totalBefore += prim.vertexCount;
+        prim.vertexOffset = packedOffsets[i];
+        prim.vertexCount = prim.weldedCount;
+    }
+    std::cout << "Welded vertices: " << totalBefore << " -> " << packedCount << std::endl;
+    vertexs.swap(packed);
+}
 
-            if (vert.pos.z < zb) {
-                zb = vert.pos.z;
+// Narrows the scene's indices to 16 bits. A primitive with at most 65536 vertices becomes one chunk whose indices
+// are relative to its first vertex. A larger one is cut, in triangle order, into chunks of at most 65536 distinct
+// vertices each, and its vertex range is rebuilt as the concatenation of the chunks' vertices. Only vertices shared
+// across a cut are duplicated, and after optimizeVertexFetch those are few. Index positions never move, so the
+// chunks of a primitive tile its original index range.
+inline void splitIndexChunks(std::vector<IrPrimitiveImport> &primitives, std::vector<Vertex> &vertexs,
+                             const std::vector<uint32_t> &wideIndices, std::vector<uint16_t> &indices,
+                             std::vector<std::vector<IrIndexChunk>> &primitiveChunks, IrJobSystem &jobSystem)
+{
+    const uint32_t chunkVertices = 65536;
+    const uint32_t unassigned = std::numeric_limits<uint32_t>::max();
+
+    // Per primitive: the source vertex (relative to the primitive) of every output vertex, empty when unchanged.
+    std::vector<std::vector<uint32_t>> sourceVertices(primitives.size());
+    std::vector<size_t> outputCounts(primitives.size());
+    primitiveChunks.assign(primitives.size(), {});
+    indices.resize(wideIndices.size());
+
+    jobSystem.parallelFor(static_cast<uint32_t>(primitives.size()), 16, [&](uint32_t first, uint32_t count) {
+        std::vector<uint32_t> localOf;
+        for (uint32_t p = first; p < first + count; p++)
+        {
+            const IrPrimitiveImport &prim = primitives[p];
+            const uint32_t *in = wideIndices.data() + prim.indexOffset;
+            uint16_t *out = indices.data() + prim.indexOffset;
+            std::vector<IrIndexChunk> &chunks = primitiveChunks[p];
+
+            if (prim.vertexCount <= chunkVertices)
+            {
+                for (size_t i = 0; i < prim.indexCount; i++)
+                {
+                    out[i] = static_cast<uint16_t>(in[i] - prim.vertexOffset);
+                }
+                chunks.push_back({static_cast<uint32_t>(prim.indexOffset), static_cast<uint32_t>(prim.indexCount), 0});
+                outputCounts[p] = prim.vertexCount;
+                continue;
             }
-            else if (vert.pos.z > zf) {
-                zf = vert.pos.z;
+
+            std::vector<uint32_t> &sources = sourceVertices[p];
+            localOf.assign(prim.vertexCount, unassigned);
+            size_t chunkStart = 0;       // first index of the open chunk
+            size_t chunkFirstVertex = 0; // its first output vertex
+            for (size_t t = 0; t + 2 < prim.indexCount; t += 3)
+            {
+                uint32_t added = 0;
+                for (int k = 0; k < 3; k++)
+                {
+                    added += (localOf[in[t + k] - prim.vertexOffset] == unassigned) ? 1 : 0;
+                }
+                if (sources.size() - chunkFirstVertex + added > chunkVertices)
+                {
+                    chunks.push_back({static_cast<uint32_t>(prim.indexOffset + chunkStart),
+                                      static_cast<uint32_t>(t - chunkStart), static_cast<int32_t>(chunkFirstVertex)});
+                    for (size_t v = chunkFirstVertex; v < sources.size(); v++)
+                    {
+                        localOf[sources[v]] = unassigned;
+                    }
+                    chunkStart = t;
+                    chunkFirstVertex = sources.size();
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    uint32_t source = in[t + k] - static_cast<uint32_t>(prim.vertexOffset);
+                    if (localOf[source] == unassigned)
+                    {
+                        localOf[source] = static_cast<uint32_t>(sources.size() - chunkFirstVertex);
+                        sources.push_back(source);
+                    }
+                    out[t + k] = static_cast<uint16_t>(localOf[source]);
+                }
             }
-            vert.flags = 0;
+            chunks.push_back({static_cast<uint32_t>(prim.indexOffset + chunkStart),
+                              static_cast<uint32_t>(prim.indexCount - chunkStart),
+                              static_cast<int32_t>(chunkFirstVertex)});
+            outputCounts[p] = sources.size();
+        }
+    });
+
+    // Only split primitives change size; rebuild the vertex array if there are any.
+    bool anySplit = false;
+    for (const std::vector<uint32_t> &sources : sourceVertices)
+    {
+        anySplit = anySplit || !sources.empty();
+    }
+    std::vector<size_t> outputOffsets(primitives.size());
+    size_t outputCount = 0;
+    for (size_t p = 0; p < primitives.size(); p++)
+    {
+        outputOffsets[p] = outputCount;
+        outputCount += outputCounts[p];
+    }
 
-            if (primitive.material == -1) {
-                vert.flags |= 1;
+    std::vector<Vertex> output(anySplit ? outputCount : 0);
+    jobSystem.parallelFor(static_cast<uint32_t>(primitives.size()), 16, [&](uint32_t first, uint32_t count) {
+        for (uint32_t p = first; p < first + count; p++)
+        {
+            IrPrimitiveImport &prim = primitives[p];
+            if (anySplit)
+            {
+                const Vertex *source = vertexs.data() + prim.vertexOffset;
+                Vertex *target = output.data() + outputOffsets[p];
+                if (sourceVertices[p].empty())
+                {
+                    std::copy(source, source + prim.vertexCount, target);
+                }
+                for (size_t v = 0; v < sourceVertices[p].size(); v++)
+                {
+                    target[v] = source[sourceVertices[p][v]];
+                }
+            }
+            prim.vertexOffset = outputOffsets[p];
+            prim.vertexCount = outputCounts[p];
+            for (IrIndexChunk &chunk : primitiveChunks[p])
+            {
+                chunk.vertexOffset += static_cast<int32_t>(prim.vertexOffset);
             }
+        }
+    });
+    if (anySplit)
+    {
+        vertexs.swap(output);
+    }
+}
 
+// Builds the meshlets of every chunk in parallel and concatenates them in draw order. buildDrawList emits one draw
+// list item per chunk in the same order, so the flattened chunk index is the item index.
+inline void buildSceneMeshlets(const std::vector<std::vector<IrIndexChunk>> &primitiveChunks,
+                               const std::vector<Vertex> &vertexs, const std::vector<uint16_t> &indices,
+                               std::vector<IrMeshlet> &meshlets, IrJobSystem &jobSystem)
+{
+    std::vector<uint32_t> firstDraws(primitiveChunks.size());
+    uint32_t drawCount = 0;
+    for (size_t p = 0; p < primitiveChunks.size(); p++)
+    {
+        firstDraws[p] = drawCount;
+        drawCount += static_cast<uint32_t>(primitiveChunks[p].size());
+    }
 
-            vert.normal =
-                glm::normalize(getMatrix(node) * glm::vec4(glm::vec3(normalsBuffer ? glm::make_vec3(&normalsBuffer[v * 3]) : glm::vec3(0.0f)),1.0f));
-            vert.uv = texCoordsBuffer ? glm::make_vec2(&texCoordsBuffer[v * 2]) : glm::vec3(0.0f);
-            vert.color = glm::vec3(1.0f);
-            vertexs.push_back(vert);
+    std::vector<std::vector<IrMeshlet>> primitiveMeshlets(primitiveChunks.size());
+    jobSystem.parallelFor(static_cast<uint32_t>(primitiveChunks.size()), 16, [&](uint32_t first, uint32_t count) {
+        for (uint32_t p = first; p < first + count; p++)
+        {
+            for (size_t c = 0; c < primitiveChunks[p].size(); c++)
+            {
+                buildMeshlets(primitiveChunks[p][c], firstDraws[p] + static_cast<uint32_t>(c), vertexs.data(),
+                              indices.data(), primitiveMeshlets[p]);
+            }
         }
+    });
+
+    meshlets.clear();
+    for (const std::vector<IrMeshlet> &clusters : primitiveMeshlets)
+    {
+        meshlets.insert(meshlets.end(), clusters.begin(), clusters.end());
+    }
+    if (!meshlets.empty())
+    {
+        std::cout << "Meshlets: " << meshlets.size() << ", " << double(indices.size() / 3) / meshlets.size()
+                  << " triangles each" << std::endl;
     }
 }
 
-inline void loadNode(tinygltf::Node &node, std::vector<Vertex> &vertexs, std::vector<uint32_t> &indices, int &firstIndex, std::unordered_map<int, int> &firstIndexs)
+// Keeps the encoded bytes of every image so parsing stays cheap; decodeImage does the decode later, off the
+// parsing thread.
+inline bool deferImageDecode(tinygltf::Image *image, const int imageIndex, std::string *err, std::string *warn,
+                             int reqWidth, int reqHeight, const unsigned char *bytes, int size, void *userData)
 {
-    if (node.mesh != -1) {
-            tinygltf::Mesh mesh = model.meshes[node.mesh];
-            loadMesh(mesh, vertexs, indices, firstIndex, firstIndexs,node);
+    image->image.assign(bytes, bytes + size);
+    image->width = -1;
+    image->height = -1;
+    image->component = -1;
+    return true;
+}
+
+inline IrMappedFile mappedGlb;
+
+// Parses a .glb in place: the file is memory-mapped, only its JSON chunk goes through tinygltf, and the buffer stored
+// in the BIN chunk is read from the mapping (see gltfBufferData) instead of being copied into model.buffers.
+// tinygltf always copies a GLB's BIN chunk, so the JSON is patched first: the BIN buffer and every image stored in a
+// buffer view get a one-byte data URI, and the images are pointed back at their views afterwards for decodeImage.
+inline bool loadGlbMapped(const std::string &filename, std::string &err, std::string &warn)
+{
+    const uint32_t glbMagic = 0x46546C67;     // "glTF"
+    const uint32_t jsonChunkType = 0x4E4F534A; // "JSON"
+    const uint32_t binChunkType = 0x004E4942;  // "BIN\0"
+    const char *placeholderUri = "data:application/octet-stream;base64,AA==";
+
+    if (!mappedGlb.map(filename))
+    {
+        err = "failed to map " + filename;
+        return false;
     }
+    const uint8_t *file = mappedGlb.data;
+    size_t fileSize = mappedGlb.size;
+    auto read32 = [file](size_t offset) {
+        uint32_t value;
+        std::memcpy(&value, file + offset, sizeof(value));
+        return value;
+    };
 
+    size_t jsonLength = (fileSize >= 20) ? read32(12) : 0;
+    if (fileSize < 20 || read32(0) != glbMagic || read32(4) != 2 || read32(16) != jsonChunkType ||
+        20 + jsonLength > fileSize)
+    {
+        err = filename + " is not a valid glTF 2.0 binary";
+        mappedGlb.unmap();
+        return false;
+    }
 
-    if (node.children.size() > 0)
+    const uint8_t *bin = nullptr;
+    size_t binChunk = 20 + jsonLength;
+    if (binChunk + 8 <= fileSize && read32(binChunk + 4) == binChunkType)
     {
-        for (size_t i = 0; i < node.children.size(); i++)
+        bin = file + binChunk + 8;
+        if (binChunk + 8 + read32(binChunk) > fileSize)
         {
+            err = filename + " has a truncated BIN chunk";
+            mappedGlb.unmap();
+            return false;
+        }
+    }
+
+    nlohmann::json json = nlohmann::json::parse(file + 20, file + 20 + jsonLength, nullptr, false);
+    if (json.is_discarded())
+    {
+        err = filename + " has an invalid JSON chunk";
+        mappedGlb.unmap();
+        return false;
+    }
+
+    // Only the first buffer can live in the BIN chunk, and it is the one without a uri.
+    bool binBuffer = bin && json.contains("buffers") && !json["buffers"].empty() && !json["buffers"][0].contains("uri");
+    if (binBuffer)
+    {
+        json["buffers"][0]["uri"] = placeholderUri;
+        json["buffers"][0]["byteLength"] = 1;
+    }
 
-            loadNode(model.nodes[node.children[i]], vertexs, indices, firstIndex, firstIndexs);
+    std::vector<std::pair<size_t, int>> imageViews;
+    if (json.contains("images"))
+    {
+        for (size_t i = 0; i < json["images"].size(); i++)
+        {
+            nlohmann::json &image = json["images"][i];
+            if (image.contains("bufferView"))
+            {
+                imageViews.push_back({i, image["bufferView"].get<int>()});
+                image.erase("bufferView");
+                image["uri"] = placeholderUri;
+            }
         }
     }
+
+    std::string patched = json.dump();
+    json = nullptr;
+
+    tinygltf::TinyGLTF loader;
+    loader.SetImageLoader(deferImageDecode, nullptr);
+    size_t slash = filename.find_last_of("/\\");
+    std::string baseDir = (slash == std::string::npos) ? std::string() : filename.substr(0, slash);
+    if (!loader.LoadASCIIFromString(&model, &err, &warn, patched.c_str(), static_cast<unsigned int>(patched.size()),
+                                    baseDir))
+    {
+        mappedGlb.unmap();
+        return false;
+    }
+
+    for (const auto &[image, view] : imageViews)
+    {
+        model.images[image].bufferView = view;
+        model.images[image].image.clear();
+    }
+    if (binBuffer)
+    {
+        model.buffers[0].data.clear();
+        model.buffers[0].uri.clear();
+        mappedBuffer = 0;
+        mappedBufferData = bin;
+    }
+    return true;
 }
 
-inline void loadModel(const std::string filename, std::vector<Vertex> &vertexs, std::vector<uint32_t> &indices, int &firstIndex, std::unordered_map<int, int> &firstIndexs)
+inline void loadGltf(const std::string filename)
 {
     tinygltf::TinyGLTF loader;
+    loader.SetImageLoader(deferImageDecode, nullptr);
     std::string err;
     std::string warn;
 
-    bool res = loader.LoadBinaryFromFile(&model, &err, &warn, filename);
+    bool glb = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".glb") == 0;
+    bool res = (mapGlbFiles && glb) ? loadGlbMapped(filename, err, warn)
+                                    : loader.LoadBinaryFromFile(&model, &err, &warn, filename);
     //bool res = loader.LoadASCIIFromFile(&model, &err, &warn, filename);
     if (!warn.empty())
     {
@@ -246,39 +685,160 @@ inline void loadModel(const std::string filename, std::vector<Vertex> &vertexs,
         std::cout << "Failed to load glTF: " << filename << std::endl;
     else
         std::cout << "Loaded glTF: " << filename << std::endl;
+}
 
+// Imports the default scene into vertexs and 16-bit indices, replacing their contents, in two phases: a serial
+// counting pass sizes the output once and fixes every primitive's offsets, then the primitives are converted in
+// parallel, in jobs of roughly equal vertex and index counts. primitiveChunks receives the index chunks of every
+// primitive instance in scene order, the order IrDrawList::buildDrawList walks, and meshlets the clusters of every
+// chunk, tagged with the draw list item the chunk becomes.
+inline void loadScene(std::vector<Vertex> &vertexs, std::vector<uint16_t> &indices,
+                      std::vector<std::vector<IrIndexChunk>> &primitiveChunks, std::vector<IrMeshlet> &meshlets,
+                      IrJobSystem &jobSystem)
+{
     const tinygltf::Scene &scene = model.scenes[model.defaultScene];
 
-    for (size_t i = 0; i < scene.nodes.size(); i++)
+    std::vector<IrPrimitiveImport> primitives;
+    size_t vertexCount = 0;
+    size_t indexCount = 0;
+    for (int node : scene.nodes)
     {
-        tinygltf::Node node = model.nodes[scene.nodes[i]];
-        loadNode(node, vertexs, indices, firstIndex, firstIndexs);
+        countNode(model.nodes[node], primitives, vertexCount, indexCount);
     }
-}
+    vertexs.resize(vertexCount);
+    std::vector<uint32_t> wideIndices(indexCount);
 
-inline void loadImages(std::vector<IrTexture> &Textures)
-{
-    for (auto glTFImage : model.images)
+    size_t totalWork = 0;
+    for (const IrPrimitiveImport &prim : primitives)
+    {
+        totalWork += prim.vertexCount + prim.indexCount;
+    }
+    size_t jobWork = std::max<size_t>(totalWork / (4 * jobSystem.threadCount()), 1 << 16);
+
+    std::vector<IrJobHandle> jobs;
+    for (size_t first = 0; first < primitives.size();)
     {
-        IrTexture texture;
-        std::vector<uint8_t> imagedata;
-        if (glTFImage.component == 3)
+        size_t last = first;
+        size_t work = 0;
+        while (last < primitives.size() && (last == first || work < jobWork))
         {
-            imagedata.resize(glTFImage.width * glTFImage.height * 4);
-            for (size_t j = 0; j < glTFImage.width * glTFImage.height; j++)
+            work += primitives[last].vertexCount + primitives[last].indexCount;
+            last++;
+        }
+        jobs.push_back(jobSystem.schedule([&primitives, &vertexs, &wideIndices, first, last]() {
+            for (size_t i = first; i < last; i++)
             {
-                imagedata.insert(imagedata.end(), &(glTFImage.image[3 * j]), &(glTFImage.image[3 * j + 3]));
-                imagedata.push_back(static_cast<uint8_t>(0xFF));
+                loadPrimitive(primitives[i], vertexs.data(), wideIndices.data());
+                if (weldVertices)
+                {
+                    weldPrimitive(primitives[i], vertexs.data(), wideIndices.data());
+                }
+                if (optimizeMeshes)
+                {
+                    optimizePrimitive(primitives[i], vertexs.data(), wideIndices.data());
+                }
             }
+        }));
+        first = last;
+    }
+    jobSystem.wait(jobs);
+    if (weldVertices)
+    {
+        packWeldedVertices(primitives, vertexs, wideIndices, jobSystem);
+    }
+    if (optimizeMeshes)
+    {
+        size_t misses[2] = {0, 0};
+        size_t triangleCount = 0;
+        size_t usedVertices = 0;
+        for (const IrPrimitiveImport &prim : primitives)
+        {
+            misses[0] += prim.cacheMissesBefore;
+            misses[1] += prim.cacheMissesAfter;
+            triangleCount += prim.indexCount / 3;
+            usedVertices += prim.weldedCount;
         }
-        else
+        if (triangleCount != 0 && usedVertices != 0)
         {
-            imagedata.insert(imagedata.end(), &(glTFImage.image[0]),
-                             &(glTFImage.image[0]) + glTFImage.width * glTFImage.height * 4);
+            std::cout << "Vertex cache ACMR " << double(misses[0]) / triangleCount << " -> "
+                      << double(misses[1]) / triangleCount << ", ATVR " << double(misses[0]) / usedVertices << " -> "
+                      << double(misses[1]) / usedVertices << std::endl;
         }
-        texture.createTextureByBuffer(imagedata, glTFImage.width, glTFImage.height);
-        Textures.push_back(texture);
     }
+
+    splitIndexChunks(primitives, vertexs, wideIndices, indices, primitiveChunks, jobSystem);
+    buildSceneMeshlets(primitiveChunks, vertexs, indices, meshlets, jobSystem);
+
+    for (const IrPrimitiveImport &prim : primitives)
+    {
+        if (prim.vertexCount == 0)
+        {
+            continue;
+        }
+        xl = std::min(xl, prim.boundsMin.x);
+        xr = std::max(xr, prim.boundsMax.x);
+        yb = std::min(yb, prim.boundsMin.y);
+        yt = std::max(yt, prim.boundsMax.y);
+        zb = std::min(zb, prim.boundsMin.z);
+        zf = std::max(zf, prim.boundsMax.z);
+    }
+}
+
+// Decodes one image left encoded by deferImageDecode into RGBA8. Images are independent, so this runs as one job
+// per image.
+inline void decodeImage(tinygltf::Image &glTFImage)
+{
+    // Images of a mapped .glb are still in their buffer view; everything else was copied by deferImageDecode.
+    const uint8_t *encoded = glTFImage.image.data();
+    size_t encodedSize = glTFImage.image.size();
+    if (glTFImage.image.empty() && glTFImage.bufferView >= 0)
+    {
+        const tinygltf::BufferView &view = model.bufferViews[glTFImage.bufferView];
+        encoded = gltfBufferData(model, view.buffer) + view.byteOffset;
+        encodedSize = view.byteLength;
+    }
+
+    int width, height, component;
+    stbi_uc *pixels = stbi_load_from_memory(encoded, static_cast<int>(encodedSize), &width, &height, &component,
+                                            STBI_rgb_alpha);
+    if (!pixels)
+    {
+        throw std::runtime_error("failed to decode glTF image " + glTFImage.name + ": " + stbi_failure_reason());
+    }
+
+    glTFImage.image.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+    glTFImage.width = width;
+    glTFImage.height = height;
+    glTFImage.component = 4;
+    glTFImage.bits = 8;
+    glTFImage.pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+    stbi_image_free(pixels);
+}
+
+inline void decodeImages(IrJobSystem &jobSystem)
+{
+    jobSystem.parallelFor(static_cast<uint32_t>(model.images.size()), 1, [](uint32_t first, uint32_t count) {
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            decodeImage(model.images[i]);
+        }
+    });
+}
+
+// Frees what the vertex, index and texture uploads were built from, and unmaps the .glb if it was mapped.
+inline void releaseGltfData()
+{
+    for (tinygltf::Buffer &buffer : model.buffers)
+    {
+        std::vector<unsigned char>().swap(buffer.data);
+    }
+    for (tinygltf::Image &image : model.images)
+    {
+        std::vector<unsigned char>().swap(image.image);
+    }
+    mappedBuffer = -1;
+    mappedBufferData = nullptr;
+    mappedGlb.unmap();
 }
 
 inline void loadTexture(std::vector<uint32_t> textures)
@@ -9,9 +9,14 @@
 
 #include "irbuffer.h"
 #include "irdescriptor.h"
+#include "irdrawlist.h"
 #include "irframebuffer.h"
+#include "irframescheduler.h"
+#include "irjobsystem.h"
+#include "irmeshcache.h"
 #include "irpipeline.h"
 #include "irrenderpass.h"
+#include "irsecondaryrecorder.h"
 #include "irswapchain.h"
 
 #include "model.h"
@@ -34,7 +39,9 @@
 #include <vector>
 
 #include "geometry.h"
+#include "ircullpass.h"
 #include "irdebugpass.h"
+#include "irsoftocclusion.h"
 #include "iroffscreen.h"
 #include "tool.h"
 
@@ -54,27 +61,53 @@ class Render
     void initWindow();
     static void framebufferResizeCallback(GLFWwindow *window, int width, int height);
     void mainLoop();
+    void waitForLoaderJobs();
     void cleanup();
     void createInstance();
     void createUniformBuffer();
-    void drawNode(tinygltf::Node node, VkPipelineLayout pipelineLayout);
-    void draw(VkPipelineLayout pipelineLayout);
+    void draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t passMask, uint32_t first,
+              uint32_t count);
+    uint32_t passItemCount(uint32_t passMask);
     bool checkValidationLayerSupport();
     std::vector<const char *> getRequiredExtensions();
     void drawFrame();
+    void presentFrame(uint32_t imageIndex);
+    void recordLoadingCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+    void streamAssets();
+    void createScene();
+    void streamTextures();
+    void bindLandedTextures();
     void createSyncObjects();
-    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+    void createRenderFinishedSemaphores();
+    void destroyRenderFinishedSemaphores();
+    IrSecondaryPass createShadowSecondaryPass();
+    IrSecondaryPass createMainSecondaryPass(uint32_t imageIndex);
+    VkPipelineLayout bindMainPass(VkCommandBuffer commandBuffer);
+    void recordPassContents(VkCommandBuffer commandBuffer, const VkRenderPassBeginInfo &renderPassInfo,
+                            const IrSecondaryPass &pass);
+    void recordShadowCommandBuffer(VkCommandBuffer commandBuffer, const IrSecondaryPass &shadowPass);
+    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, const IrSecondaryPass &mainPass);
     void createIndexBuffer();
     void createVertexBuffer();
+    void reportMemoryPlacement();
     VkSampleCountFlagBits getMaxUsableSampleCount();
     void generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels);
     bool hasStencilComponent(VkFormat format);
     void createSurface();
     void cpyBuffer();
-    void createCommandBuffer();
+    void createCommandBuffers();
+    void createCachedCommandBuffers();
+    void markCommandBuffersDirty();
     void setupDebugMessenger();
     void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo);
     void createDescriptorSet();
+    void createDrawList();
+    void packVertices();
+    void loadCookedModel();
+    void cookModel();
+    void createIndirectDraws();
+    void createDepthPyramid();
+    void recreateSwapChain();
     void createRenderPass();
     void createFrameBuffer();
     void createPipeLine();
@@ -94,6 +127,14 @@ class Render
 
     IrDebugPass debugpass;
     IrOffscreenResource offscreen;
+    IrCullPass cullPass;
+    IrDepthPyramid depthPyramid;
+    IrSoftwareOcclusion cpuOcclusion;
+    IrSoftwareOcclusion cpuShadowOcclusion; // separate depth buffer, so both views are culled concurrently
+    std::vector<uint8_t> cpuShadowVisible; // per draw list item, rebuilt every frame by cpuOcclusion
+    std::vector<uint8_t> cpuMainVisible;
+
+    IrJobSystem *jobSystem = nullptr; // owned by Engine
 
     GLFWwindow *window;
 
@@ -102,13 +143,16 @@ class Render
     VkSurfaceKHR surface;
 
     IrBuffer indexBuffer;
-    IrBuffer vertexBuffer;
+    IrBuffer vertexBuffer;   // IrPackedVertex, for the main pass
+    IrBuffer positionBuffer; // positions only, for the shadow pass
     IrFrameBuffer frameBuffer;
 
     IrSwapChain swapchain;
 
-    std::vector<Vertex> vertices;
-    std::vector<uint32_t> indices;
+    std::vector<Vertex> vertices; // import result, split into the two streams below by packVertices
+    std::vector<IrPackedVertex> packedVertices;
+    std::vector<glm::vec3> positions;
+    std::vector<uint16_t> indices; // relative to each draw's vertexOffset
 
     IrRenderpass renderpass;
 
@@ -116,20 +160,56 @@ class Render
     IrShadowRenderPipeline shadowRenderPipeline;
 
     IrShadowRenderDescriptor shadowRenderDescriptor;
+    IrIndirectDescriptor indirectDescriptor;
 
     IrUniformBuffer uniformBuffer;
     UniformScreen ubo;
 
-    VkCommandBuffer commandBuffer;
-
-    VkSemaphore imageAvailableSemaphore;
-    VkSemaphore renderFinishedSemaphore;
-    VkFence inFlightFence;
+    std::vector<VkCommandBuffer> shadowCommandBuffers;
+    std::vector<VkCommandBuffer> commandBuffers;
+
+    // With cacheCommandBuffers the primaries are recorded once and re-submitted until something they bake in
+    // changes. The main pass depends on the frame's uniform slice and cull buffers as well as the swap chain
+    // image, so there is one cached buffer per (frame in flight, image): [frame * imageCount + imageIndex].
+    std::vector<VkCommandBuffer> cachedCommandBuffers;
+    std::vector<uint8_t> cachedMainValid;
+    std::array<bool, MAX_FRAMES_IN_FLIGHT> cachedShadowValid{};
+    bool commandBuffersDirty = true;
+    UniformScreen recordedUbo{};
+    bool recordedDebugShadow = false;
+    bool recordedFilterPCF = false;
+
+    std::vector<VkSemaphore> imageAvailableSemaphores;
+    std::vector<VkSemaphore> renderFinishedSemaphores; // per swap chain image, signalled for its present
+    IrFrameScheduler frameScheduler;
+    IrSecondaryRecorder secondaryRecorder;
+    uint32_t currentFrame = 0;
 
     std::vector<IrTexture> irTextures;
 
-    int firstIndex = 0;
-    std::unordered_map<int, int> firstIndexs;
+    std::vector<std::vector<IrIndexChunk>> primitiveChunks; // per primitive instance, from loadScene
+    std::vector<IrMeshlet> meshlets;                        // in draw list order, from loadScene or the cache
+    IrDrawList drawList;
+    IrMeshCache meshCache; // open from initVulkan until the draw list is built when the cooked cache was valid
+    IrIndirectDraws indirectDraws;
+    IrUploadBatch uploadBatch; // every upload; recorded and submitted on the main thread only
+
+    // Asset streaming. initVulkan only starts the import and the render loop presents right away; streamAssets,
+    // called at every frame boundary, creates the scene once it is imported, stages a few textures per frame and
+    // swaps each one in for the placeholder once its upload has landed.
+    IrJobHandle sceneLoaded; // null when the cooked cache is valid
+    IrJobHandle imagesDecoded;
+    IrJobHandle modelCooked;
+    IrTexture placeholderTexture;
+    uint64_t geometryUpload = 0;          // upload batch value the scene's buffers land with
+    std::vector<uint64_t> textureUploads; // per texture, the upload batch value it lands with
+    uint32_t texturesRecorded = 0;
+    uint32_t texturesBound = 0; // textures [0, texturesBound) have landed
+    std::array<uint32_t, MAX_FRAMES_IN_FLIGHT> slotTexturesBound{}; // per frame slot, how many its sets point at
+    bool sceneCreated = false;
+    bool sceneVisible = false; // the geometry has landed, so frames draw the scene
+    bool importReleased = false;
+    bool assetsStreamed = false;
 
     bool framebufferResized = false;
 };
\ No newline at end of file
@@ -5,6 +5,7 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
 #include <array>
 #include <optional>
 #include <set>
@@ -23,6 +24,8 @@
 
 inline const uint32_t WIDTH = 800;
 inline const uint32_t HEIGHT = 600;
+inline const VkDeviceSize stagingRingSize = VkDeviceSize(64) << 20;
+inline const VkDeviceSize streamingBudget = VkDeviceSize(16) << 20; // texture bytes staged per frame while streaming
 
 // inline const std::string modePath = "D:/Downloads/BoomBoxWithAxes.gltf";
 inline const std::string modePath = "C:/Users/Administrator/Desktop/wudi.glb";
@@ -43,13 +46,33 @@ inline VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
 inline VkDevice device;
 inline VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
 inline VkCommandPool commandPool;
+inline VkCommandPool transferCommandPool; // commandPool itself without a dedicated transfer queue
 inline VkQueue graphicsQueue;
 inline VkQueue presentQueue;
+inline VkQueue transferQueue; // graphicsQueue without a dedicated transfer queue
+inline uint32_t graphicsQueueFamily = 0;
+inline uint32_t transferQueueFamily = 0;
 inline VkSampler sampler;
 inline VkDescriptorPool descriptorPool;
 inline bool debugshadow = false;
 inline bool filterPCF = true;
+inline bool indirectDraw = true;
+inline bool gpuCulling = true;
+inline bool occlusionCulling = true;
+inline bool clusterCulling = true;
+inline bool cpuOcclusionCulling = true;       // main view, where the GPU path does not occlusion-cull
+inline bool cpuShadowOcclusionCulling = true; // light view, where there is no GPU culling at all
+inline bool cacheCommandBuffers = false;
+inline bool mapGlbFiles = true;
+inline bool useMeshCache = true;
+inline bool weldVertices = true;
+inline bool optimizeMeshes = true;
+inline bool dedicatedTransferQueue = true;
+inline bool multiDrawIndirectSupported = false;
+inline uint32_t maxDrawIndirectCount = 1;
 inline const uint32_t shadowMapize = 2048;
+inline const uint32_t MAX_FRAMES_IN_FLIGHT = 2;
+inline const uint32_t maxDepthPyramidLevels = 16;
 
 inline float xl = std::numeric_limits<float>::max();
 inline float xr = std::numeric_limits<float>::lowest();
@@ -65,6 +88,7 @@ struct QueueFamilyIndices
 {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    std::optional<uint32_t> transferFamily; // transfer only, no graphics or compute: the copy engine if there is one
 
     bool isComplete()
     {
@@ -87,6 +111,13 @@ struct UniformScreen
     alignas(16) glm::mat4 depthMVP;
     alignas(16) glm::vec4 lightPos;
     alignas(16) glm::vec4 viewPos;
+
+    // Member by member rather than bytewise, so a member added with padding cannot make equal values differ.
+    bool operator==(const UniformScreen &other) const
+    {
+        return model == other.model && proj == other.proj && view == other.view && depthMVP == other.depthMVP &&
+               lightPos == other.lightPos && viewPos == other.viewPos;
+    }
 };
 
 
@@ -103,20 +134,32 @@ inline QueueFamilyIndices findQueueFamilies(VkPhysicalDevice physicalDevice, VkS
     int i = 0;
     for (const auto &queueFamily : queueFamilies)
     {
-        if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+        if (!indices.isComplete())
         {
-            indices.graphicsFamily = i;
+            if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+            {
+                indices.graphicsFamily = i;
+            }
+
+            VkBool32 presentSupport = false;
+            vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupport);
+
+            if (presentSupport)
+            {
+                indices.presentFamily = i;
+            }
         }
 
-        VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupport);
-
-        if (presentSupport)
+        // Texture uploads copy bands of rows at any offset, so the family must transfer single texels.
+        const VkExtent3D &granularity = queueFamily.minImageTransferGranularity;
+        if (!indices.transferFamily.has_value() && (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+            !(queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) && granularity.width == 1 &&
+            granularity.height == 1 && granularity.depth == 1)
         {
-            indices.presentFamily = i;
+            indices.transferFamily = i;
         }
 
-        if (indices.isComplete())
+        if (indices.isComplete() && indices.transferFamily.has_value())
         {
             break;
         }
@@ -129,17 +172,26 @@ inline QueueFamilyIndices findQueueFamilies(VkPhysicalDevice physicalDevice, VkS
 
 inline void createDescriptorPool(size_t size)
 {
-    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    // Per frame in flight: size textures for the per-texture sets plus max(size, 1) for the indirect path's texture
+    // array and its material buffer
+    std::array<VkDescriptorPoolSize, 5> poolSizes{};
     poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = 3;
-    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[1].descriptorCount = size + 2;
+    poolSizes[0].descriptorCount = 1 + MAX_FRAMES_IN_FLIGHT;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSizes[1].descriptorCount = 2;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[2].descriptorCount =
+        MAX_FRAMES_IN_FLIGHT * (size + std::max<size_t>(size, 1)) + 2 + MAX_FRAMES_IN_FLIGHT + maxDepthPyramidLevels;
+    poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[3].descriptorCount = 8 * MAX_FRAMES_IN_FLIGHT;
+    poolSizes[4].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[4].descriptorCount = maxDepthPyramidLevels;
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
     poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = size + 5;
+    poolInfo.maxSets = MAX_FRAMES_IN_FLIGHT * (size + 1) + 5 + MAX_FRAMES_IN_FLIGHT + maxDepthPyramidLevels;
 
     if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
     {
@@ -171,12 +223,52 @@ inline void createSampler()
     }
 }
 
+inline VkFormat findSupportedFormat(const std::vector<VkFormat> &candidates, VkImageTiling tiling,
+                                    VkFormatFeatureFlags features)
+{
+    for (VkFormat format : candidates)
+    {
+        VkFormatProperties props;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
+
+        if (tiling == VK_IMAGE_TILING_LINEAR && (props.linearTilingFeatures & features) == features)
+        {
+            return format;
+        }
+        else if (tiling == VK_IMAGE_TILING_OPTIMAL && (props.optimalTilingFeatures & features) == features)
+        {
+            return format;
+        }
+    }
+
+    throw std::runtime_error("failed to find supported format!");
+}
+inline VkFormat findDepthFormat()
+{
+    return findSupportedFormat({VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
+                               VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+}
+
+// Whether a min/max reduction sampler may linearly filter format with optimal tiling.
+inline bool supportsMinmaxFilter(VkFormat format)
+{
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
+    return (props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_MINMAX_BIT) != 0;
+}
+
 inline void createLogicalDevice(VkSurfaceKHR surface)
 {
     QueueFamilyIndices indices = findQueueFamilies(physicalDevice, surface);
 
+    // Uploads run on the copy engine when the device has one, beside rendering instead of between frames.
+    dedicatedTransferQueue = dedicatedTransferQueue && indices.transferFamily.has_value();
+    graphicsQueueFamily = indices.graphicsFamily.value();
+    transferQueueFamily = dedicatedTransferQueue ? indices.transferFamily.value() : graphicsQueueFamily;
+
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value(),
+                                              transferQueueFamily};
 
     float queuePriority = 1.0f;
     for (uint32_t queueFamily : uniqueQueueFamilies)
@@ -189,11 +281,66 @@ inline void createLogicalDevice(VkSurfaceKHR surface)
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
+    VkPhysicalDeviceVulkan12Features supportedVulkan12Features{};
+    supportedVulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+    VkPhysicalDeviceFeatures2 supportedFeatures2{};
+    supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supportedFeatures2.pNext = &supportedVulkan12Features;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures2);
+    const VkPhysicalDeviceFeatures &supportedFeatures = supportedFeatures2.features;
+
+    VkPhysicalDeviceVulkan12Properties vulkan12Properties{};
+    vulkan12Properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+
+    VkPhysicalDeviceProperties2 properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &vulkan12Properties;
+    vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+    const VkPhysicalDeviceProperties &properties = properties2.properties;
+
     VkPhysicalDeviceFeatures deviceFeatures{};
     deviceFeatures.samplerAnisotropy = VK_TRUE;
+    deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+    deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan12Features.timelineSemaphore = VK_TRUE;
+    vulkan12Features.shaderSampledImageArrayNonUniformIndexing =
+        supportedVulkan12Features.shaderSampledImageArrayNonUniformIndexing;
+    vulkan12Features.runtimeDescriptorArray = supportedVulkan12Features.runtimeDescriptorArray;
+    vulkan12Features.drawIndirectCount = supportedVulkan12Features.drawIndirectCount;
+    vulkan12Features.samplerFilterMinmax = supportedVulkan12Features.samplerFilterMinmax;
+
+    // The indirect path reads per-draw materials through firstInstance and indexes the texture array per draw.
+    multiDrawIndirectSupported = supportedFeatures.multiDrawIndirect;
+    maxDrawIndirectCount = multiDrawIndirectSupported ? properties.limits.maxDrawIndirectCount : 1;
+    indirectDraw = indirectDraw && supportedFeatures.drawIndirectFirstInstance &&
+                   supportedVulkan12Features.shaderSampledImageArrayNonUniformIndexing &&
+                   supportedVulkan12Features.runtimeDescriptorArray;
+    // On CPU devices (lavapipe, SwiftShader) the compute cull passes would run on the same cores as the SIMD
+    // software culler, and slower, so culling stays on the CPU there.
+    bool softwareDevice = properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU;
+    // The count draws issue a whole pass in one call, which needs multiDrawIndirect.
+    gpuCulling = gpuCulling && indirectDraw && supportedFeatures.multiDrawIndirect &&
+                 supportedVulkan12Features.drawIndirectCount && !softwareDevice;
+    // The depth pyramid is reduced with a max sampler, so each texel holds the farthest depth it covers. Level 0
+    // samples the depth buffer and every other level the R32_SFLOAT level above it.
+    occlusionCulling = occlusionCulling && gpuCulling && supportedVulkan12Features.samplerFilterMinmax &&
+                       vulkan12Properties.filterMinmaxSingleComponentFormats &&
+                       supportsMinmaxFilter(findDepthFormat()) && supportsMinmaxFilter(VK_FORMAT_R32_SFLOAT);
+    // Meshlets are culled by the same compute pass and drawn through the same count buffer.
+    clusterCulling = clusterCulling && gpuCulling;
+    // The CPU culler covers the main view wherever there is no depth pyramid: software devices and anything
+    // without draw indirect count or min/max filtering. For the shadow view it has no light frustum test, so it
+    // only replaces the GPU light frustum cull and its count draws where those are missing.
+    cpuOcclusionCulling = cpuOcclusionCulling && !occlusionCulling;
+    cpuShadowOcclusionCulling = cpuShadowOcclusionCulling && !gpuCulling;
 
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    createInfo.pNext = &vulkan12Features;
 
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
@@ -220,6 +367,7 @@ inline void createLogicalDevice(VkSurfaceKHR surface)
 
     vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
     vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+    vkGetDeviceQueue(device, transferQueueFamily, 0, &transferQueue);
 }
 
 inline VkSampleCountFlagBits getMaxUsableSampleCount()
@@ -311,7 +459,6 @@ inline bool isDeviceSuitable(VkPhysicalDevice device, VkSurfaceKHR surface)
     VkPhysicalDeviceProperties deviceProperties;
 
     vkGetPhysicalDeviceProperties(device, &deviceProperties);
-    bool isDiscreteGPU = deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU;
 
     bool swapChainAdequate = false;
     if (extensionsSupported)
@@ -320,11 +467,17 @@ inline bool isDeviceSuitable(VkPhysicalDevice device, VkSurfaceKHR surface)
         swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
     }
 
-    VkPhysicalDeviceFeatures supportedFeatures;
-    vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+    VkPhysicalDeviceFeatures2 supportedFeatures2{};
+    supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supportedFeatures2.pNext = &vulkan12Features;
+    vkGetPhysicalDeviceFeatures2(device, &supportedFeatures2);
+    const VkPhysicalDeviceFeatures &supportedFeatures = supportedFeatures2.features;
 
     return indices.isComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy &&
-           isDiscreteGPU;
+           vulkan12Features.timelineSemaphore;
 }
 
 inline void createAllocator(VkInstance instance)
@@ -354,16 +507,32 @@ inline void pickPhysicalDevice(VkInstance instance, VkSurfaceKHR surface)
     std::vector<VkPhysicalDevice> devices(deviceCount);
     vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
 
+    // Prefer a discrete GPU, but accept integrated and software devices (e.g. lavapipe in CI).
     for (const auto &device : devices)
     {
-        if (isDeviceSuitable(device, surface))
+        if (!isDeviceSuitable(device, surface))
+        {
+            continue;
+        }
+
+        VkPhysicalDeviceProperties deviceProperties;
+        vkGetPhysicalDeviceProperties(device, &deviceProperties);
+        if (physicalDevice == VK_NULL_HANDLE ||
+            deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
         {
             physicalDevice = device;
-            msaaSamples = getMaxUsableSampleCount();
+        }
+        if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
+        {
             break;
         }
     }
 
+    if (physicalDevice != VK_NULL_HANDLE)
+    {
+        msaaSamples = getMaxUsableSampleCount();
+    }
+
     if (physicalDevice == VK_NULL_HANDLE)
     {
         throw std::runtime_error("failed to find a suitable GPU!");
@@ -383,4 +552,15 @@ inline void createCommandPool(VkSurfaceKHR surface)
     {
         throw std::runtime_error("failed to create graphics command pool!");
     }
+
+    transferCommandPool = commandPool;
+    if (dedicatedTransferQueue)
+    {
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = transferQueueFamily;
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, &transferCommandPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create transfer command pool!");
+        }
+    }
 }
\ No newline at end of file
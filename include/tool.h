@@ -5,6 +5,11 @@
 #include "resourceManager.h"
 #include <GLFW/glfw3.h>
 
+// Where the pipelines load the SPIR-V of the shaders in shaders/ from, defined by CMake as its output directory.
+#ifndef IR_SHADER_DIR
+#error "IR_SHADER_DIR must name the directory CMake compiles shaders/ into"
+#endif
+
 inline VkCommandBuffer beginSingleTimeCommands()
 {
     VkCommandBufferAllocateInfo allocInfo{};
@@ -39,32 +44,6 @@ inline void endSingleTimeCommands(VkCommandBuffer &commandBuffer)
 
     vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
 }
-inline VkFormat findSupportedFormat(const std::vector<VkFormat> &candidates, VkImageTiling tiling,
-                                    VkFormatFeatureFlags features)
-{
-    for (VkFormat format : candidates)
-    {
-        VkFormatProperties props;
-        vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
-
-        if (tiling == VK_IMAGE_TILING_LINEAR && (props.linearTilingFeatures & features) == features)
-        {
-            return format;
-        }
-        else if (tiling == VK_IMAGE_TILING_OPTIMAL && (props.optimalTilingFeatures & features) == features)
-        {
-            return format;
-        }
-    }
-
-    throw std::runtime_error("failed to find supported format!");
-}
-inline VkFormat findDepthFormat()
-{
-    return findSupportedFormat({VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
-                               VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
-}
-
 inline std::vector<char> readFile(const std::string &filename)
 {
     std::ifstream file(filename, std::ios::ate | std::ios::binary);
@@ -0,0 +1,62 @@
+// Body of cluster_cull.comp and cluster_cull_occlusion.comp: one invocation per meshlet, appending a command for
+// every survivor to binding 8, counted in counts[3].
+
+#include "cull.glsl"
+
+// IrMeshlet (irmeshlet.h).
+struct Meshlet
+{
+    vec4 sphere;   // xyz center, w radius
+    vec4 coneApex; // xyz apex
+    vec4 coneAxis; // xyz axis, w cutoff
+    uint firstIndex;
+    uint indexCount;
+    int vertexOffset;
+    uint drawIndex;
+};
+
+layout(std430, set = 0, binding = 7) readonly buffer Meshlets
+{
+    Meshlet meshlets[];
+};
+
+layout(std430, set = 0, binding = 8) writeonly buffer ClusterDraws
+{
+    DrawCommand clusterDraws[];
+};
+
+void main()
+{
+    uint id = gl_GlobalInvocationID.x;
+    if (id >= cull.meshletCount)
+    {
+        return;
+    }
+
+    Meshlet meshlet = meshlets[id];
+#ifdef OCCLUSION
+    // The early pass only draws what was visible last frame; the late pass draws the rest as whole draws.
+    if (visibility[meshlet.drawIndex] == 0)
+    {
+        return;
+    }
+#endif
+    if (!sphereInFrustum(meshlet.sphere, false))
+    {
+        return;
+    }
+    // Every triangle faces away from the camera. Like the frustum planes, cameraPosition is in model space, and
+    // the test only compares directions, so the model's scale does not enter.
+    if (dot(normalize(meshlet.coneApex.xyz - cull.cameraPosition.xyz), meshlet.coneAxis.xyz) >= meshlet.coneAxis.w)
+    {
+        return;
+    }
+
+    DrawCommand command;
+    command.indexCount = meshlet.indexCount;
+    command.instanceCount = 1;
+    command.firstIndex = meshlet.firstIndex;
+    command.vertexOffset = meshlet.vertexOffset;
+    command.firstInstance = meshlet.drawIndex;
+    clusterDraws[atomicAdd(counts[3], 1)] = command;
+}
@@ -0,0 +1,145 @@
+// Declarations shared by the cull shaders of IrCullPass (ircullpass.h). The bindings follow IrCullDescriptor, the
+// uniform block follows UniformCull and the commands are VkDrawIndexedIndirectCommand.
+
+layout(local_size_x = 64) in; // IrCullPass::workgroupSize
+
+layout(set = 0, binding = 0) uniform UniformCull
+{
+    vec4 cameraPlanes[6]; // inward facing, normalized, in model space
+    vec4 lightPlanes[6];
+    mat4 cameraModelView;
+    vec4 projection; // P00, P11, znear, unused
+    vec2 pyramidSize;
+    uint shadowCount;
+    uint mainCount;
+    uint meshletCount;
+    vec4 cameraPosition; // model space
+} cull;
+
+struct DrawBounds
+{
+    vec4 sphere; // xyz center, w radius
+    vec4 aabbMin;
+    vec4 aabbMax;
+};
+
+struct DrawCommand
+{
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance; // the draw slot, indexes bounds and visibility
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer Bounds
+{
+    DrawBounds bounds[];
+};
+
+// IrIndirectDraws::indirectBuffer: the shadowCount shadow commands, then the mainCount main commands.
+layout(std430, set = 0, binding = 2) readonly buffer Candidates
+{
+    DrawCommand candidates[];
+};
+
+layout(std430, set = 0, binding = 3) writeonly buffer Draws
+{
+    DrawCommand draws[];
+};
+
+layout(std430, set = 0, binding = 4) buffer Counts
+{
+    uint counts[4]; // shadow, main, late, meshlets
+};
+
+const uint regionShadow = 0;
+const uint regionMain = 1;
+const uint regionLate = 2;
+
+// The draw buffer has the candidate layout, followed by mainCount commands for the late pass.
+void appendDraw(DrawCommand command, uint region)
+{
+    uint base = 0;
+    if (region == regionMain)
+    {
+        base = cull.shadowCount;
+    }
+    else if (region == regionLate)
+    {
+        base = cull.shadowCount + cull.mainCount;
+    }
+    draws[base + atomicAdd(counts[region], 1)] = command;
+}
+
+// The planes are normalized in model space, so the model space radius applies as is.
+bool sphereInFrustum(vec4 sphere, bool shadow)
+{
+    for (int i = 0; i < 6; i++)
+    {
+        vec4 plane = shadow ? cull.lightPlanes[i] : cull.cameraPlanes[i];
+        if (dot(plane.xyz, sphere.xyz) + plane.w < -sphere.w)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef OCCLUSION
+// One entry per draw slot: whether the draw passed the occlusion test of the last late cull.
+layout(std430, set = 0, binding = 5) buffer Visibility
+{
+    uint visibility[];
+};
+
+// Max-reduced: every texel holds the farthest depth of the area it covers.
+layout(set = 0, binding = 6) uniform sampler2D depthPyramid;
+
+// Screen rect of a view space sphere (Mara and McGuire 2013, "2D Polyhedral Bounds of a Clipped,
+// Perspective-Projected 3D Sphere"), with z the distance in front of the camera. The sphere must lie in front of
+// the near plane. Returns the rect as (min, max) in pyramid uv.
+vec4 projectSphere(vec3 c, float r)
+{
+    vec3 cr = c * r;
+    float czr2 = c.z * c.z - r * r;
+
+    float vx = sqrt(c.x * c.x + czr2);
+    float minx = (vx * c.x - cr.z) / (vx * c.z + cr.x);
+    float maxx = (vx * c.x + cr.z) / (vx * c.z - cr.x);
+
+    float vy = sqrt(c.y * c.y + czr2);
+    float miny = (vy * c.y - cr.z) / (vy * c.z + cr.y);
+    float maxy = (vy * c.y + cr.z) / (vy * c.z - cr.y);
+
+    // P11 is negative (the Vulkan y flip), so the y bounds swap.
+    vec2 a = vec2(minx, miny) * cull.projection.xy;
+    vec2 b = vec2(maxx, maxy) * cull.projection.xy;
+    return vec4(min(a, b), max(a, b)) * 0.5 + 0.5;
+}
+
+// False only when the whole sphere is behind what the depth pyramid holds. Spheres crossing the near plane are
+// kept.
+bool sphereUnoccluded(vec4 sphere)
+{
+    vec3 center = (cull.cameraModelView * vec4(sphere.xyz, 1.0)).xyz;
+    center.z = -center.z; // the view looks down -z
+    // cameraModelView includes the model's uniform scale (Render::createUniformBuffer), the radius has to follow.
+    float radius = sphere.w * length(cull.cameraModelView[0].xyz);
+    float znear = cull.projection.z;
+    if (center.z < radius + znear)
+    {
+        return true;
+    }
+
+    vec4 rect = projectSphere(center, radius);
+    vec2 size = (rect.zw - rect.xy) * cull.pyramidSize;
+    float level = floor(log2(max(size.x, size.y)));
+    float depth = textureLod(depthPyramid, (rect.xy + rect.zw) * 0.5, level).x;
+
+    // The depth of the nearest point for an infinite far plane. The real far plane only pushes depths further
+    // back, so this errs towards visible.
+    float sphereDepth = 1.0 - znear / (center.z - radius);
+    return sphereDepth <= depth;
+}
+#endif
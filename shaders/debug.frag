@@ -0,0 +1,14 @@
+#version 450
+
+// Shows the shadow map's raw depth in grey; the binding follows IrDebugDescriptor.
+layout(set = 0, binding = 1) uniform sampler2D shadowMap;
+
+layout(location = 0) in vec2 inUV;
+
+layout(location = 0) out vec4 outFragColor;
+
+void main()
+{
+    float depth = texture(shadowMap, inUV).r;
+    outFragColor = vec4(vec3(depth), 1.0);
+}
@@ -0,0 +1,15 @@
+#version 450
+
+// Shadow pass, depth only (IrOffscreenPipeline). The input is the position stream, the uniform block follows
+// UniformOffscreen (iroffscreen.h).
+layout(set = 0, binding = 0) uniform UniformOffscreen
+{
+    mat4 depthMVP;
+} ubo;
+
+layout(location = 0) in vec3 inPos;
+
+void main()
+{
+    gl_Position = ubo.depthMVP * vec4(inPos, 1.0);
+}
@@ -0,0 +1,16 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "shading.glsl"
+
+// The draw's base color texture, rebound per draw (IrTexture::descriptorSet).
+layout(set = 1, binding = 0) uniform sampler2D samplerColorMap;
+
+layout(location = 5) flat in uint inFlags;
+
+void main()
+{
+    // Primitives without a material are drawn white.
+    vec3 baseColor = ((inFlags & 1u) != 0u) ? vec3(1.0) : texture(samplerColorMap, inUV).rgb;
+    outFragColor = shade(baseColor);
+}
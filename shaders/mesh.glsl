@@ -0,0 +1,55 @@
+// Vertex stage of the main pass, shared by mesh.vert and mesh_indirect.vert. The inputs follow IrPackedVertex
+// (geometry.h) as getAttributeDescriptions in irpipeline.h describes it, the uniform block follows UniformScreen
+// (resourceManager.h).
+
+layout(set = 0, binding = 0) uniform UniformScreen
+{
+    mat4 model;
+    mat4 proj;
+    mat4 view;
+    mat4 depthMVP; // already includes model
+    vec4 lightPos;
+    vec4 viewPos;
+} ubo;
+
+layout(location = 0) in vec3 inPos;
+layout(location = 1) in vec2 inNormal; // octahedral, R16G16_SNORM
+layout(location = 2) in vec2 inUV;     // R16G16_SFLOAT
+layout(location = 4) in uint inFlags;  // bit 0: the primitive has no material
+
+layout(location = 0) out vec3 outNormal;
+layout(location = 1) out vec2 outUV;
+layout(location = 2) out vec3 outViewVec;
+layout(location = 3) out vec3 outLightVec;
+layout(location = 4) out vec4 outShadowCoord;
+
+// Light clip space xy [-1, 1] to shadow map uv [0, 1]; depth is already [0, 1].
+const mat4 biasMat = mat4(0.5, 0.0, 0.0, 0.0,
+                          0.0, 0.5, 0.0, 0.0,
+                          0.0, 0.0, 1.0, 0.0,
+                          0.5, 0.5, 0.0, 1.0);
+
+// Inverse of octahedralEncode in geometry.h, which folds with sign(0) = 1.
+vec3 octahedralDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+    {
+        vec2 s = mix(vec2(-1.0), vec2(1.0), greaterThanEqual(n.xy, vec2(0.0)));
+        n.xy = (1.0 - abs(n.yx)) * s;
+    }
+    return normalize(n);
+}
+
+// Lighting is done in world space.
+void transformVertex()
+{
+    vec4 worldPos = ubo.model * vec4(inPos, 1.0);
+    gl_Position = ubo.proj * ubo.view * worldPos;
+
+    outNormal = mat3(ubo.model) * octahedralDecode(inNormal);
+    outUV = inUV;
+    outViewVec = ubo.viewPos.xyz - worldPos.xyz;
+    outLightVec = ubo.lightPos.xyz - worldPos.xyz;
+    outShadowCoord = biasMat * ubo.depthMVP * vec4(inPos, 1.0);
+}
@@ -0,0 +1,12 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "mesh.glsl"
+
+layout(location = 5) flat out uint outFlags;
+
+void main()
+{
+    transformVertex();
+    outFlags = inFlags;
+}
@@ -0,0 +1,20 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+#include "shading.glsl"
+
+// Sized by IrIndirectDescriptor to the scene's texture count, at least one element.
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+layout(location = 5) flat in int inTextureIndex;
+
+void main()
+{
+    vec3 baseColor = vec3(1.0);
+    if (inTextureIndex >= 0)
+    {
+        baseColor = texture(textures[nonuniformEXT(inTextureIndex)], inUV).rgb;
+    }
+    outFragColor = shade(baseColor);
+}
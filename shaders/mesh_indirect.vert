@@ -0,0 +1,24 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "mesh.glsl"
+
+// IrDrawMaterial (irdrawlist.h). Every indirect command uses its draw slot as firstInstance.
+struct DrawMaterial
+{
+    int textureIndex; // -1 for primitives without a material
+    uint flags;
+};
+
+layout(std430, set = 1, binding = 1) readonly buffer Materials
+{
+    DrawMaterial materials[];
+};
+
+layout(location = 5) flat out int outTextureIndex;
+
+void main()
+{
+    transformVertex();
+    outTextureIndex = materials[gl_InstanceIndex].textureIndex;
+}
@@ -0,0 +1,61 @@
+// Fragment stage of the main pass, shared by mesh.frag and mesh_indirect.frag: diffuse and specular lighting from
+// one point light, shadowed through the shadow map at set 0 binding 1. Specialization constant 0 selects the 3x3
+// PCF filter (the pcfPipeline variants in irpipeline.h).
+
+layout(set = 0, binding = 1) uniform sampler2D shadowMap;
+
+layout(constant_id = 0) const uint enablePCF = 0;
+
+layout(location = 0) in vec3 inNormal;
+layout(location = 1) in vec2 inUV;
+layout(location = 2) in vec3 inViewVec;
+layout(location = 3) in vec3 inLightVec;
+layout(location = 4) in vec4 inShadowCoord;
+
+layout(location = 0) out vec4 outFragColor;
+
+const float ambient = 0.1;
+
+float textureProj(vec4 shadowCoord, vec2 offset)
+{
+    float shadow = 1.0;
+    if (shadowCoord.z > 0.0 && shadowCoord.z < 1.0)
+    {
+        float dist = texture(shadowMap, shadowCoord.st + offset).r;
+        if (shadowCoord.w > 0.0 && dist < shadowCoord.z)
+        {
+            shadow = ambient;
+        }
+    }
+    return shadow;
+}
+
+float filterPCF(vec4 shadowCoord)
+{
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0));
+
+    float shadowFactor = 0.0;
+    for (int x = -1; x <= 1; x++)
+    {
+        for (int y = -1; y <= 1; y++)
+        {
+            shadowFactor += textureProj(shadowCoord, texelSize * vec2(x, y));
+        }
+    }
+    return shadowFactor / 9.0;
+}
+
+vec4 shade(vec3 baseColor)
+{
+    vec4 shadowCoord = inShadowCoord / inShadowCoord.w;
+    float shadow = (enablePCF == 1) ? filterPCF(shadowCoord) : textureProj(shadowCoord, vec2(0.0));
+
+    vec3 N = normalize(inNormal);
+    vec3 L = normalize(inLightVec);
+    vec3 V = normalize(inViewVec);
+    vec3 R = reflect(-L, N);
+
+    vec3 diffuse = max(dot(N, L), ambient) * baseColor;
+    vec3 specular = pow(max(dot(R, V), 0.0), 32.0) * vec3(0.25);
+    return vec4((diffuse + specular) * shadow, 1.0);
+}
@@ -2,5 +2,8 @@
 
 void Engine::run()
 {
+    jobSystem.createJobSystem();
+    render.jobSystem = &jobSystem;
     render.run();
+    jobSystem.destroyJobSystem();
 }
\ No newline at end of file
@@ -16,8 +16,24 @@
 void Render::run()
 {
     initWindow();
-    initVulkan();
-    mainLoop();
+    try
+    {
+        initVulkan();
+        mainLoop();
+    }
+    catch (...)
+    {
+        // The loader jobs start before the device exists and capture this, so a failed startup or frame must not
+        // unwind past them. Their own errors are secondary to the one being reported.
+        try
+        {
+            waitForLoaderJobs();
+        }
+        catch (...)
+        {
+        }
+        throw;
+    }
     cleanup();
 }
 
@@ -206,11 +222,21 @@ void Render::cleanup()
 
     // vkDestroyBuffer(device, vertexBuffer, nullptr);
 
-    vkDestroySemaphore(device, renderFinishedSemaphore, nullptr);
-    vkDestroySemaphore(device, imageAvailableSemaphore, nullptr);
-    vkDestroyFence(device, inFlightFence, nullptr);
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
+    }
+    destroyRenderFinishedSemaphores();
+    frameScheduler.destroyFrameScheduler();
 
+    secondaryRecorder.destroySecondaryRecorder();
+    uploadBatch.destroyUploadBatch();
+    if (dedicatedTransferQueue)
+    {
+        vkDestroyCommandPool(device, transferCommandPool, nullptr);
+    }
     vkDestroyCommandPool(device, commandPool, nullptr);
+    stagingRing.destroyStagingRing();
 
     vkDestroyDevice(device, nullptr);
 
@@ -251,25 +277,73 @@ void Render::createUniformBuffer()
 
     matrix = glm::mat4(1.0f);
 
-    offscreen.createOffscreenUniformBuffer(ubo);
+    offscreen.createOffscreenUniformBuffer(uploadBatch, ubo);
 
-    uniformBuffer.copytoUniformBuffer(ubo);
+    uniformBuffer.createIrUniformBuffer(sizeof(ubo), MAX_FRAMES_IN_FLIGHT);
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        uniformBuffer.copytoSlice(i, ubo);
+    }
 }
 
-void Render::draw(VkPipelineLayout pipelineLayout)
+void Render::draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t passMask, uint32_t first,
+                  uint32_t count)
 {
-
+    // The depth-only shadow pipeline fetches nothing but positions, from their own tightly packed stream.
     VkDeviceSize offsets[1] = {0};
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer.buffer, offsets);
-    vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+    VkBuffer vertexStream = (passMask & IR_PASS_SHADOW) ? positionBuffer.buffer : vertexBuffer.buffer;
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexStream, offsets);
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+
+    // A pass culled on the CPU draws its visible items one by one, even where the GPU path exists.
+    bool cpuCulled = (passMask & IR_PASS_SHADOW) ? cpuShadowOcclusionCulling : cpuOcclusionCulling;
+    if (gpuCulling && !cpuCulled)
+    {
+        cullPass.draw(commandBuffer, currentFrame, passMask);
+        return;
+    }
+
+    if (indirectDraw && !cpuCulled)
+    {
+        indirectDraws.draw(commandBuffer, passMask);
+        return;
+    }
+
+    // Only the main pass samples the base color texture; skip rebinding when consecutive draws share it. The
+    // indirect pipeline reads textures through firstInstance instead, so the draw slot is passed there.
+    bool bindTextures = (passMask & IR_PASS_MAIN) && !indirectDraw;
+    VkDescriptorSet boundTexture = VK_NULL_HANDLE;
+    const std::vector<uint8_t> &visible = (passMask & IR_PASS_SHADOW) ? cpuShadowVisible : cpuMainVisible;
+
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        const IrDrawItem &item = drawList.items[i];
+        if (!(item.passMask & passMask) || (cpuCulled && !visible[i]))
+        {
+            continue;
+        }
 
-    const tinygltf::Scene &scene = model.scenes[model.defaultScene];
+        if (bindTextures && item.textureIndex != -1 &&
+            irTextures[item.textureIndex].descriptorSets[currentFrame] != boundTexture)
+        {
+            boundTexture = irTextures[item.textureIndex].descriptorSets[currentFrame];
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1,
+                                    &boundTexture, 0, nullptr);
+        }
+
+        vkCmdDrawIndexed(commandBuffer, item.indexCount, 1, item.firstIndex, item.vertexOffset, i);
+    }
+}
 
-    for (size_t i = 0; i < scene.nodes.size(); i++)
+// The culled and indirect paths issue the whole pass from one buffer, so only the flat list can be split.
+uint32_t Render::passItemCount(uint32_t passMask)
+{
+    bool cpuCulled = (passMask & IR_PASS_SHADOW) ? cpuShadowOcclusionCulling : cpuOcclusionCulling;
+    if (((gpuCulling || indirectDraw) && !cpuCulled) || ((passMask & IR_PASS_MAIN) && debugshadow))
     {
-        tinygltf::Node node = model.nodes[scene.nodes[i]];
-        drawNode(node,pipelineLayout);
+        return 1;
     }
+    return static_cast<uint32_t>(drawList.items.size());
 }
 
 bool Render::checkValidationLayerSupport()
@@ -320,15 +394,17 @@ std::vector<const char *> Render::getRequiredExtensions()
 
 void Render::drawFrame()
 {
-    vkWaitForFences(device, 1, &inFlightFence, VK_TRUE, UINT64_MAX);
+    streamAssets();
+    frameScheduler.beginFrame(currentFrame);
+    bindLandedTextures();
 
     uint32_t imageIndex;
-    VkResult result = vkAcquireNextImageKHR(device, swapchain.swapChain, UINT64_MAX, imageAvailableSemaphore,
-                                            VK_NULL_HANDLE, &imageIndex);
+    VkResult result = vkAcquireNextImageKHR(device, swapchain.swapChain, UINT64_MAX,
+                                            imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
 
     if (result == VK_ERROR_OUT_OF_DATE_KHR)
     {
-        swapchain.recreateSwapChain(window, surface, renderpass.renderPass, frameBuffer.swapChainFramebuffers);
+        recreateSwapChain();
         return;
     }
     else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
@@ -336,32 +412,116 @@ void Render::drawFrame()
         throw std::runtime_error("failed to acquire swap chain image!");
     }
 
-    vkResetFences(device, 1, &inFlightFence);
+    // Until the scene's geometry has landed there is nothing to draw but the cleared frame.
+    if (!sceneVisible)
+    {
+        VkCommandBuffer commandBuffer = commandBuffers[currentFrame];
+        vkResetCommandBuffer(commandBuffer, /*VkCommandBufferResetFlagBits*/ 0);
+        recordLoadingCommandBuffer(commandBuffer, imageIndex);
+        frameScheduler.frameValues[currentFrame] =
+            frameScheduler.submit(graphicsQueue, commandBuffer, 0, 0, {imageAvailableSemaphores[currentFrame]},
+                                  {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT},
+                                  {renderFinishedSemaphores[imageIndex]});
+        presentFrame(imageIndex);
+        return;
+    }
 
-    vkResetCommandBuffer(commandBuffer, /*VkCommandBufferResetFlagBits*/ 0);
-    recordCommandBuffer(commandBuffer, imageIndex);
+    // The timeline has passed this frame's last value, so its slice and command buffers are free to reuse.
+    uniformBuffer.copytoSlice(currentFrame, ubo);
+    if (gpuCulling)
+    {
+        cullPass.updateFrustums(currentFrame, ubo.view * ubo.model, ubo.proj, offscreen.uos.depthMVP);
+    }
 
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    // A cached recording is reused as long as nothing it baked in has changed since it was recorded.
+    VkCommandBuffer shadowCommandBuffer = shadowCommandBuffers[currentFrame];
+    VkCommandBuffer commandBuffer = commandBuffers[currentFrame];
+    size_t cachedIndex = currentFrame * swapchain.swapChainImages.size() + imageIndex;
+    if (cacheCommandBuffers)
+    {
+        if (ubo != recordedUbo || debugshadow != recordedDebugShadow || filterPCF != recordedFilterPCF)
+        {
+            markCommandBuffersDirty();
+        }
+        if (commandBuffersDirty)
+        {
+            std::fill(cachedMainValid.begin(), cachedMainValid.end(), 0);
+            cachedShadowValid.fill(false);
+            recordedUbo = ubo;
+            recordedDebugShadow = debugshadow;
+            recordedFilterPCF = filterPCF;
+            commandBuffersDirty = false;
+        }
+        commandBuffer = cachedCommandBuffers[cachedIndex];
+    }
+    bool recordShadow = !cacheCommandBuffers || !cachedShadowValid[currentFrame];
+    bool recordMain = !cacheCommandBuffers || !cachedMainValid[cachedIndex];
 
-    VkSemaphore waitSemaphores[] = {imageAvailableSemaphore};
-    VkPipelineStageFlags waitStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = waitSemaphores;
-    submitInfo.pWaitDstStageMask = &waitStages;
+    if (recordShadow || recordMain)
+    {
+        IrJobHandle mainCulled;
+        if (cpuOcclusionCulling)
+        {
+            mainCulled = jobSystem->schedule(
+                [this]() { cpuOcclusion.cull(ubo.proj * ubo.view * ubo.model, positions, indices, cpuMainVisible); });
+        }
+        if (cpuShadowOcclusionCulling)
+        {
+            cpuShadowOcclusion.cull(offscreen.uos.depthMVP, positions, indices, cpuShadowVisible);
+        }
+        if (mainCulled)
+        {
+            jobSystem->wait(mainCulled);
+        }
+    }
 
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
+    if (cacheCommandBuffers)
+    {
+        // Only re-recorded after an invalidation, so the draws go inline on this thread; secondaries from the
+        // recorder would not survive the next reset of this frame's worker pools.
+        if (recordShadow)
+        {
+            IrSecondaryPass shadowPass = createShadowSecondaryPass();
+            recordShadowCommandBuffer(shadowCommandBuffer, shadowPass);
+            cachedShadowValid[currentFrame] = true;
+        }
+        if (recordMain)
+        {
+            IrSecondaryPass mainPass = createMainSecondaryPass(imageIndex);
+            recordCommandBuffer(commandBuffer, imageIndex, mainPass);
+            cachedMainValid[cachedIndex] = 1;
+        }
+    }
+    else
+    {
+        // Both passes' draws are recorded in parallel; the primaries only wrap them with culling and render passes.
+        secondaryRecorder.beginFrame(currentFrame);
+        IrSecondaryPass shadowPass = createShadowSecondaryPass();
+        IrSecondaryPass mainPass = createMainSecondaryPass(imageIndex);
+        secondaryRecorder.record(currentFrame, {&shadowPass, &mainPass});
 
-    VkSemaphore signalSemaphores[] = {renderFinishedSemaphore};
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = signalSemaphores;
+        vkResetCommandBuffer(shadowCommandBuffer, /*VkCommandBufferResetFlagBits*/ 0);
+        recordShadowCommandBuffer(shadowCommandBuffer, shadowPass);
 
-    if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFence) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to submit draw command buffer!");
+        vkResetCommandBuffer(commandBuffer, /*VkCommandBufferResetFlagBits*/ 0);
+        recordCommandBuffer(commandBuffer, imageIndex, mainPass);
     }
 
+    uint64_t shadowValue = frameScheduler.submit(graphicsQueue, shadowCommandBuffer, 0, 0);
+
+    frameScheduler.frameValues[currentFrame] = frameScheduler.submit(
+        graphicsQueue, commandBuffer, shadowValue, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        {imageAvailableSemaphores[currentFrame]}, {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT},
+        {renderFinishedSemaphores[imageIndex]});
+
+    presentFrame(imageIndex);
+}
+
+// Presents imageIndex once this frame's rendering has finished and moves on to the next frame in flight.
+void Render::presentFrame(uint32_t imageIndex)
+{
+    VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[imageIndex]};
+
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
@@ -374,38 +534,191 @@ void Render::drawFrame()
 
     presentInfo.pImageIndices = &imageIndex;
 
-    result = vkQueuePresentKHR(presentQueue, &presentInfo);
+    VkResult result = vkQueuePresentKHR(presentQueue, &presentInfo);
 
     if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized)
     {
         framebufferResized = false;
-        swapchain.recreateSwapChain(window, surface, renderpass.renderPass, frameBuffer.swapChainFramebuffers);
+        recreateSwapChain();
     }
     else if (result != VK_SUCCESS)
     {
         throw std::runtime_error("failed to present swap chain image!");
     }
+
+    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 }
 
-void Render::createSyncObjects()
+// Advances asset streaming by at most one frame's worth of work; it never blocks on the import or on an upload.
+void Render::streamAssets()
 {
+    if (assetsStreamed)
+    {
+        return;
+    }
 
-    VkSemaphoreCreateInfo semaphoreInfo{};
-    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    if (!sceneCreated)
+    {
+        if (!jobSystem->isFinished(sceneLoaded))
+        {
+            return;
+        }
+        createScene();
+    }
+    if (!sceneVisible && uploadBatch.landedValue() >= geometryUpload)
+    {
+        sceneVisible = true;
+    }
+
+    streamTextures();
+
+    // Every frame slot has to have caught up with the landed textures, see bindLandedTextures.
+    uint32_t slotsBound = *std::min_element(slotTexturesBound.begin(), slotTexturesBound.end());
+    if (sceneVisible && importReleased && slotsBound == irTextures.size())
+    {
+        assetsStreamed = true;
+        std::cout << "Streamed " << (uploadBatch.uploadedBytes >> 20) << " MiB in " << uploadBatch.submissions
+                  << " submission(s) on the " << (dedicatedTransferQueue ? "transfer" : "graphics") << " queue"
+                  << std::endl;
+    }
+}
+
+// Everything that depends on the imported scene. Its buffers are uploaded in one submission, so the scene appears
+// whole; every texture starts out as the placeholder and is streamed in by streamTextures.
+void Render::createScene()
+{
+    uint32_t textureCount;
+    if (meshCache.isOpen())
+    {
+        loadCookedModel();
+        textureCount = meshCache.header->imageCount;
+    }
+    else
+    {
+        jobSystem->wait(sceneLoaded); // rethrows an import error
+        textureCount = static_cast<uint32_t>(model.images.size());
+    }
+    irTextures.assign(textureCount, placeholderTexture);
+
+    createDescriptorSetLayout();
+    createUniformBuffer();
+    createVertexBuffer();
+    createIndexBuffer();
+    cpyBuffer();
+    createDescriptorPool(irTextures.size());
+    createOffscreenResource();
+    createDescriptorSet();
+    createDepthPyramid();
+    createDrawList();
+    createIndirectDraws();
+    createPipeLine();
+    reportMemoryPlacement();
+
+    geometryUpload = uploadBatch.submit();
+    textureUploads.assign(textureCount, 0);
+    sceneCreated = true;
+}
+
+// Records the next textures' uploads, up to streamingBudget bytes, in one submission. A texture's image only
+// replaces the placeholder in a frame slot's descriptors once bindLandedTextures sees its upload land. After the last
+// texture the import data is released, from a job when a fresh import still has to be cooked first.
+void Render::streamTextures()
+{
+    if (importReleased)
+    {
+        return;
+    }
+    if (!meshCache.isOpen())
+    {
+        if (!jobSystem->isFinished(imagesDecoded))
+        {
+            return;
+        }
+        jobSystem->wait(imagesDecoded); // rethrows a decoding error
+    }
+
+    uint32_t first = texturesRecorded;
+    VkDeviceSize recorded = 0;
+    while (texturesRecorded < irTextures.size() && recorded < streamingBudget)
+    {
+        IrTexture &texture = irTextures[texturesRecorded];
+        if (meshCache.isOpen())
+        {
+            const IrCookedImage &image = meshCache.section<IrCookedImage>(meshCache.header->images)[texturesRecorded];
+            texture.createTextureByBuffer(uploadBatch, meshCache.file.data + image.offset, image.width, image.height);
+            recorded += image.size;
+        }
+        else
+        {
+            tinygltf::Image &image = model.images[texturesRecorded];
+            texture.createTextureByBuffer(uploadBatch, image.image, image.width, image.height);
+            recorded += image.image.size();
+        }
+        texturesRecorded++;
+    }
+    if (texturesRecorded != first)
+    {
+        uint64_t value = uploadBatch.submit();
+        std::fill(textureUploads.begin() + first, textureUploads.begin() + texturesRecorded, value);
+    }
+    if (texturesRecorded != irTextures.size())
+    {
+        return;
+    }
+
+    if (meshCache.isOpen())
+    {
+        meshCache.close();
+        std::vector<IrMeshlet>().swap(meshlets);
+    }
+    else
+    {
+        // The frames only read what cooking reads, so the two overlap.
+        modelCooked = jobSystem->schedule([this]() {
+            cookModel();
+            releaseGltfData();
+            std::vector<IrMeshlet>().swap(meshlets);
+        });
+    }
+    importReleased = true;
+}
 
-    VkFenceCreateInfo fenceInfo{};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+// Points the current frame slot's descriptors at the textures whose uploads have landed, in recording order. A
+// descriptor set must not change while a submitted frame still uses it; every slot has its own sets and beginFrame
+// has just retired this slot's last frame, so nothing waits here. Each slot catches up on its own next frame.
+void Render::bindLandedTextures()
+{
+    uint64_t landed = uploadBatch.landedValue();
+    while (texturesBound < texturesRecorded && textureUploads[texturesBound] <= landed)
+    {
+        texturesBound++;
+    }
+    uint32_t first = slotTexturesBound[currentFrame];
+    if (texturesBound == first)
+    {
+        return;
+    }
 
-    if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphore) != VK_SUCCESS ||
-        vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphore) != VK_SUCCESS ||
-        vkCreateFence(device, &fenceInfo, nullptr, &inFlightFence) != VK_SUCCESS)
+    // Textures recorded after these already hold their new image info, but their sets keep the placeholder.
+    std::vector<VkDescriptorImageInfo> textureImageInfos;
+    for (uint32_t i = 0; i < texturesBound; i++)
+    {
+        if (i >= first)
+        {
+            irTextures[i].updateDescriptorSet(currentFrame);
+        }
+        textureImageInfos.push_back(irTextures[i].descriptorSetImageInfo);
+    }
+    if (indirectDraw)
     {
-        throw std::runtime_error("failed to create synchronization objects for a frame!");
+        indirectDescriptor.updateIndirectTextures(currentFrame, textureImageInfos, first, texturesBound - first);
     }
+    slotTexturesBound[currentFrame] = texturesBound;
+    markCommandBuffersDirty();
 }
 
-void Render::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+// Clears the swap chain image; drawn while the scene is still loading.
+void Render::recordLoadingCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
 {
     VkCommandBufferBeginInfo beginInfo{};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -414,22 +727,113 @@ void Render::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIn
         throw std::runtime_error("failed to begin recording command buffer!");
     }
 
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = renderpass.renderPass;
+    renderPassInfo.framebuffer = frameBuffer.swapChainFramebuffers[imageIndex];
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = swapchain.swapChainExtent;
+
+    std::array<VkClearValue, 2> clearValues{};
+    clearValues[0].color = {{0.25f, 0.25f, 0.25f, 1.0f}};
+    clearValues[1].depthStencil = {1.0f, 0};
+
+    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+    renderPassInfo.pClearValues = clearValues.data();
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdEndRenderPass(commandBuffer);
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
     {
-        VkRenderPassBeginInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = offscreen.renderpass.renderPass;
-        renderPassInfo.framebuffer = offscreen.frameBuffer.framebuffer;
-        renderPassInfo.renderArea.offset = {0, 0};
-        renderPassInfo.renderArea.extent = VkExtent2D{shadowMapize, shadowMapize};
+        throw std::runtime_error("failed to record command buffer!");
+    }
+}
 
-        std::array<VkClearValue, 1> clearValues{};
-        clearValues[0].depthStencil = {1.0f, 0};
+// cleanupSwapChain destroys the framebuffers, and the pyramid is sized to the old depth buffer, so both are
+// rebuilt here after the device has gone idle.
+void Render::recreateSwapChain()
+{
+    swapchain.recreateSwapChain(window, surface, renderpass.renderPass, frameBuffer.swapChainFramebuffers);
+    frameBuffer.createFramebuffers(swapchain, renderpass);
+    if (renderFinishedSemaphores.size() != swapchain.swapChainImages.size())
+    {
+        destroyRenderFinishedSemaphores(); // the device is idle after the swap chain recreation
+        createRenderFinishedSemaphores();
+    }
 
-        renderPassInfo.clearValueCount = 1;
-        renderPassInfo.pClearValues = clearValues.data();
+    if (occlusionCulling && sceneCreated)
+    {
+        depthPyramid.destroyDepthPyramid();
+        depthPyramid.createDepthPyramid(swapchain.depthImage, swapchain.swapChainExtent);
+        cullPass.updatePyramid(depthPyramid);
+    }
 
-        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    createCachedCommandBuffers();
+}
+
+// Call after anything baked into recorded command buffers changes outside of ubo, debugshadow and filterPCF
+// (which drawFrame compares itself), e.g. a scene edit. Every cached buffer is re-recorded on its next use.
+void Render::markCommandBuffersDirty()
+{
+    commandBuffersDirty = true;
+}
+
+void Render::createSyncObjects()
+{
+    imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create synchronization objects for a frame!");
+        }
+    }
+    createRenderFinishedSemaphores();
+
+    frameScheduler.createFrameScheduler();
+}
+
+// The present of an image waits on its render-finished semaphore, and nothing but reacquiring that image
+// guarantees the wait is done. So there is one per swap chain image rather than per frame in flight: a frame slot
+// can come around again while the image it presented last is still queued.
+void Render::createRenderFinishedSemaphores()
+{
+    renderFinishedSemaphores.resize(swapchain.swapChainImages.size());
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    for (VkSemaphore &semaphore : renderFinishedSemaphores)
+    {
+        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create synchronization objects for a swap chain image!");
+        }
+    }
+}
+
+void Render::destroyRenderFinishedSemaphores()
+{
+    for (VkSemaphore semaphore : renderFinishedSemaphores)
+    {
+        vkDestroySemaphore(device, semaphore, nullptr);
+    }
+    renderFinishedSemaphores.clear();
+}
 
+// Draws of the shadow pass, recorded by worker threads into secondary command buffers.
+IrSecondaryPass Render::createShadowSecondaryPass()
+{
+    IrSecondaryPass pass{};
+    pass.renderPass = offscreen.renderpass.renderPass;
+    pass.framebuffer = offscreen.frameBuffer.framebuffer;
+    pass.itemCount = passItemCount(IR_PASS_SHADOW);
+    pass.recordRange = [this](VkCommandBuffer commandBuffer, uint32_t first, uint32_t count) {
         vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, offscreen.pipeline.pipelineLayout, 0, 1,
                                 &offscreen.shadowDescriptor.shadowDescriptorSet, 0, nullptr);
 
@@ -451,15 +855,152 @@ void Render::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIn
 
         vkCmdSetDepthBias(commandBuffer, depthBiasConstant, 0.0f, depthBiasSlope);
 
-        draw(offscreen.pipeline.pipelineLayout);
+        draw(commandBuffer, offscreen.pipeline.pipelineLayout, IR_PASS_SHADOW, first, count);
+    };
+    return pass;
+}
+
+// Draws of the main pass (the early pass with occlusion culling) into the swap chain image imageIndex.
+IrSecondaryPass Render::createMainSecondaryPass(uint32_t imageIndex)
+{
+    IrSecondaryPass pass{};
+    pass.renderPass = (occlusionCulling && !debugshadow) ? renderpass.earlyRenderPass : renderpass.renderPass;
+    pass.framebuffer = frameBuffer.swapChainFramebuffers[imageIndex];
+    pass.itemCount = passItemCount(IR_PASS_MAIN);
+    pass.recordRange = [this](VkCommandBuffer commandBuffer, uint32_t first, uint32_t count) {
+        VkPipelineLayout pipelineLayout = bindMainPass(commandBuffer);
+        if (debugshadow)
+        {
+            vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+        }
+        else
+        {
+            draw(commandBuffer, pipelineLayout, IR_PASS_MAIN, first, count);
+        }
+    };
+    return pass;
+}
+
+// Sets the viewport and binds the main pass pipeline and descriptor sets; returns the bound pipeline layout.
+VkPipelineLayout Render::bindMainPass(VkCommandBuffer commandBuffer)
+{
+    uint32_t uniformOffset = uniformBuffer.sliceOffset(currentFrame);
+
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = (float)swapchain.swapChainExtent.width;
+    viewport.height = (float)swapchain.swapChainExtent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = swapchain.swapChainExtent;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    if (debugshadow)
+    {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, debugpass.pipeline.pipelineLayout, 0,
+                                1, &debugpass.debugDescriptor.debugDescriptorSet, 1, &uniformOffset);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, debugpass.pipeline.graphicsPipeline);
+        return debugpass.pipeline.pipelineLayout;
+    }
+
+    if (indirectDraw)
+    {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          (filterPCF) ? shadowRenderPipeline.indirectPCFPipeline
+                                      : shadowRenderPipeline.indirectPipeline);
+
+        std::array<VkDescriptorSet, 2> descriptorSets = {shadowRenderDescriptor.shadowRenderDescriptorSet,
+                                                         indirectDescriptor.indirectDescriptorSets[currentFrame]};
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                shadowRenderPipeline.indirectPipelineLayout, 0,
+                                static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(), 1,
+                                &uniformOffset);
+        return shadowRenderPipeline.indirectPipelineLayout;
+    }
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      (filterPCF) ? shadowRenderPipeline.shadowPCFPipeline : shadowRenderPipeline.shadowPipeline);
+
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowRenderPipeline.pipelineLayout, 0, 1,
+                            &shadowRenderDescriptor.shadowRenderDescriptorSet, 1, &uniformOffset);
+    return shadowRenderPipeline.pipelineLayout;
+}
+
+// Begins the render pass and executes the pass's secondaries, or records its draws inline when it has none.
+void Render::recordPassContents(VkCommandBuffer commandBuffer, const VkRenderPassBeginInfo &renderPassInfo,
+                                const IrSecondaryPass &pass)
+{
+    if (pass.commandBuffers.empty())
+    {
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        pass.recordRange(commandBuffer, 0, pass.itemCount);
+        return;
+    }
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(pass.commandBuffers.size()), pass.commandBuffers.data());
+}
+
+void Render::recordShadowCommandBuffer(VkCommandBuffer commandBuffer, const IrSecondaryPass &shadowPass)
+{
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to begin recording command buffer!");
+    }
+
+    // Culls both passes up front; the main pass is submitted after this buffer and sees the compacted draws. With
+    // occlusion culling this is only the early main set, the rest is found after the pyramid build.
+    if (gpuCulling)
+    {
+        cullPass.recordCull(commandBuffer, currentFrame);
+    }
+
+    {
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = offscreen.renderpass.renderPass;
+        renderPassInfo.framebuffer = offscreen.frameBuffer.framebuffer;
+        renderPassInfo.renderArea.offset = {0, 0};
+        renderPassInfo.renderArea.extent = VkExtent2D{shadowMapize, shadowMapize};
+
+        std::array<VkClearValue, 1> clearValues{};
+        clearValues[0].depthStencil = {1.0f, 0};
+
+        renderPassInfo.clearValueCount = 1;
+        renderPassInfo.pClearValues = clearValues.data();
+
+        recordPassContents(commandBuffer, renderPassInfo, shadowPass);
         vkCmdEndRenderPass(commandBuffer);
     }
 
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to record command buffer!");
+    }
+}
+
+void Render::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, const IrSecondaryPass &mainPass)
+{
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to begin recording command buffer!");
+    }
+
     {
+        bool twoPhase = occlusionCulling && !debugshadow;
 
         VkRenderPassBeginInfo renderPassInfo{};
         renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = renderpass.renderPass;
+        renderPassInfo.renderPass = mainPass.renderPass;
         renderPassInfo.framebuffer = frameBuffer.swapChainFramebuffers[imageIndex];
         renderPassInfo.renderArea.offset = {0, 0};
         renderPassInfo.renderArea.extent = swapchain.swapChainExtent;
@@ -471,42 +1012,28 @@ void Render::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIn
         renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
         renderPassInfo.pClearValues = clearValues.data();
 
-        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-        VkViewport viewport{};
-        viewport.x = 0.0f;
-        viewport.y = 0.0f;
-        viewport.width = (float)swapchain.swapChainExtent.width;
-        viewport.height = (float)swapchain.swapChainExtent.height;
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
-        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-
-        VkRect2D scissor{};
-        scissor.offset = {0, 0};
-        scissor.extent = swapchain.swapChainExtent;
-        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+        recordPassContents(commandBuffer, renderPassInfo, mainPass);
+        vkCmdEndRenderPass(commandBuffer);
 
-        if (debugshadow)
+        if (twoPhase)
         {
-            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, debugpass.pipeline.pipelineLayout,
-                                    0, 1, &debugpass.debugDescriptor.debugDescriptorSet, 0, nullptr);
-            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, debugpass.pipeline.graphicsPipeline);
-            vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+            depthPyramid.recordBuild(commandBuffer);
+            cullPass.recordLateCull(commandBuffer, currentFrame);
+
+            renderPassInfo.renderPass = renderpass.lateRenderPass;
+            renderPassInfo.clearValueCount = 0;
+            renderPassInfo.pClearValues = nullptr;
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+            // A single indirect draw, so it is recorded inline; the early pass state lives in its secondaries.
+            bindMainPass(commandBuffer);
+            VkDeviceSize offsets[1] = {0};
+            vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer.buffer, offsets);
+            vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+            cullPass.drawLate(commandBuffer, currentFrame);
+
+            vkCmdEndRenderPass(commandBuffer);
         }
-        else
-        {
-            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                              (filterPCF) ? shadowRenderPipeline.shadowPCFPipeline
-                                          : shadowRenderPipeline.shadowPipeline);
-
-            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowRenderPipeline.pipelineLayout,
-                                    0, 1, &shadowRenderDescriptor.shadowRenderDescriptorSet, 0, nullptr);
-
-            draw(shadowRenderPipeline.pipelineLayout);
-        }
-
-        vkCmdEndRenderPass(commandBuffer);
     }
 
     if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
@@ -514,89 +1041,157 @@ void Render::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIn
         throw std::runtime_error("failed to record command buffer!");
     }
 }
+void Render::createCommandBuffers()
+{
+    shadowCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+
+    if (vkAllocateCommandBuffers(device, &allocInfo, shadowCommandBuffers.data()) != VK_SUCCESS ||
+        vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate command buffers!");
+    }
+
+    secondaryRecorder.createSecondaryRecorder(findQueueFamilies(physicalDevice, surface).graphicsFamily.value(),
+                                              *jobSystem);
+    createCachedCommandBuffers();
+}
 
-void Render::createCommandBuffer()
+// (Re)allocates the cached main pass buffers for the current swap chain image count and invalidates them all.
+void Render::createCachedCommandBuffers()
 {
+    if (!cachedCommandBuffers.empty())
+    {
+        vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(cachedCommandBuffers.size()),
+                             cachedCommandBuffers.data());
+    }
+
+    cachedCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT * swapchain.swapChainImages.size());
+    cachedMainValid.assign(cachedCommandBuffers.size(), 0);
 
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocInfo.commandPool = commandPool;
     allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = 1;
+    allocInfo.commandBufferCount = static_cast<uint32_t>(cachedCommandBuffers.size());
 
-    if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+    if (vkAllocateCommandBuffers(device, &allocInfo, cachedCommandBuffers.data()) != VK_SUCCESS)
     {
         throw std::runtime_error("failed to allocate command buffers!");
     }
+
+    markCommandBuffersDirty();
 }
 
-void Render::createVertexBuffer()
+// Everything the glTF import would have produced, from the mapped cache. The vertex, position and index sections
+// are staged straight from the mapping by cpyBuffer; only CPU occlusion culling needs positions and indices in
+// memory.
+void Render::loadCookedModel()
 {
-    VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-    vertexBuffer.createIrBuffer(
-        bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-        static_cast<VmaAllocationCreateFlagBits>(VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
-                                                 VMA_ALLOCATION_CREATE_MAPPED_BIT));
+    const IrMeshCacheHeader &header = *meshCache.header;
+    xl = header.modelBounds[0];
+    xr = header.modelBounds[1];
+    yb = header.modelBounds[2];
+    yt = header.modelBounds[3];
+    zb = header.modelBounds[4];
+    zf = header.modelBounds[5];
+
+    if (cpuOcclusionCulling || cpuShadowOcclusionCulling)
+    {
+        const glm::vec3 *cookedPositions = meshCache.section<glm::vec3>(header.positions);
+        const uint16_t *cookedIndices = meshCache.section<uint16_t>(header.indices);
+        positions.assign(cookedPositions, cookedPositions + header.positions.size / sizeof(glm::vec3));
+        indices.assign(cookedIndices, cookedIndices + header.indices.size / sizeof(uint16_t));
+    }
+
+    if (clusterCulling)
+    {
+        const IrMeshlet *cookedMeshlets = meshCache.section<IrMeshlet>(header.meshlets);
+        meshlets.assign(cookedMeshlets, cookedMeshlets + header.meshletCount);
+    }
 }
 
-void Render::createIndexBuffer()
+// Writes the result of a fresh glTF import to the mesh cache for the next start.
+void Render::cookModel()
 {
-    VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
-    indexBuffer.createIrBuffer(
-        bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-        static_cast<VmaAllocationCreateFlagBits>(VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
-                                                 VMA_ALLOCATION_CREATE_MAPPED_BIT));
+    if (useMeshCache)
+    {
+        const float modelBounds[6] = {xl, xr, yb, yt, zb, zf};
+        IrMeshCache::cook(modePath, *jobSystem, packedVertices, positions, indices, drawList, meshlets,
+                          model.images, modelBounds);
+    }
 }
 
-void Render::cpyBuffer()
+// Splits the imported vertices into the packed stream the main pass fetches and the position stream read by the
+// shadow pass, the CPU occlusion culler and the draw bounds, then frees the full-precision import vertices.
+void Render::packVertices()
 {
-    IrStageBuffer vertexStageBuffer;
-    IrStageBuffer indexStageBuffer;
-    vertexStageBuffer.createIrStageBuffer(vertexBuffer.bufferSize);
-    indexStageBuffer.createIrStageBuffer(indexBuffer.bufferSize);
-    vertexStageBuffer.loadData(vertices);
-    indexStageBuffer.loadData(indices);
-    vertexStageBuffer.tobuffer(vertexBuffer);
-    indexStageBuffer.tobuffer(indexBuffer);
+    packedVertices.resize(vertices.size());
+    positions.resize(vertices.size());
+    jobSystem->parallelFor(static_cast<uint32_t>(vertices.size()), 1 << 14, [this](uint32_t first, uint32_t count) {
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            packedVertices[i] = packVertex(vertices[i]);
+            positions[i] = vertices[i].pos;
+        }
+    });
+    std::vector<Vertex>().swap(vertices);
 }
 
-void Render::drawNode(tinygltf::Node node,VkPipelineLayout pipelineLayout)
+// Geometry is written once, through the upload batch, and fetched every frame, so it goes to device-local memory
+// the host cannot see; fetching it across the bus from host or BAR memory would cost every draw.
+void Render::createVertexBuffer()
 {
+    VkDeviceSize bufferSize = meshCache.isOpen() ? meshCache.header->vertices.size
+                                                 : sizeof(packedVertices[0]) * packedVertices.size();
+    vertexBuffer.createIrBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, 0);
 
-    if (node.mesh != -1)
-    {
-        for (size_t i = 0; i < model.meshes[node.mesh].primitives.size(); i++)
-        {
+    bufferSize = meshCache.isOpen() ? meshCache.header->positions.size : sizeof(positions[0]) * positions.size();
+    positionBuffer.createIrBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                                  0);
+}
 
-            tinygltf::Primitive primitive = model.meshes[node.mesh].primitives[i];
-            const tinygltf::Accessor &accessor = model.accessors[primitive.indices];
+void Render::createIndexBuffer()
+{
+    VkDeviceSize bufferSize =
+        meshCache.isOpen() ? meshCache.header->indices.size : sizeof(indices[0]) * indices.size();
+    indexBuffer.createIrBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, 0);
+}
 
-            if (pipelineLayout == shadowRenderPipeline.pipelineLayout&&(primitive.material != -1) &&
-                ((model.materials[primitive.material].pbrMetallicRoughness.baseColorTexture.index) != -1))
-            {
-                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1,
-                                        &irTextures[model
-                                                        .textures[model.materials[primitive.material]
-                                                                      .pbrMetallicRoughness.baseColorTexture.index]
-                                                        .source]
-                                             .descriptorSet,
-                                        0, nullptr);
-
-                vkCmdDrawIndexed(commandBuffer, accessor.count, 1, firstIndexs[primitive.indices], 0, 0);
-            }
-            else
-            {
-                vkCmdDrawIndexed(commandBuffer, accessor.count, 1, firstIndexs[primitive.indices], 0, 0);
-            }
-        }
+// Logs where the buffers read every frame landed: geometry should be on a device-local heap that is not host
+// visible, the per-frame uniforms host visible (and device local with resizable BAR).
+void Render::reportMemoryPlacement()
+{
+    std::cout << "Vertex buffer: " << vertexBuffer.memoryPlacement() << std::endl;
+    std::cout << "Position buffer: " << positionBuffer.memoryPlacement() << std::endl;
+    std::cout << "Index buffer: " << indexBuffer.memoryPlacement() << std::endl;
+    if (indirectDraw)
+    {
+        std::cout << "Indirect buffer: " << indirectDraws.indirectBuffer.memoryPlacement() << std::endl;
     }
+    std::cout << "Uniform buffer: " << uniformBuffer.memoryPlacement() << std::endl;
+}
 
-    if (node.children.size() > 0)
+void Render::cpyBuffer()
+{
+    if (meshCache.isOpen())
     {
-        for (size_t i = 0; i < node.children.size(); i++)
-        {
-            drawNode(model.nodes[node.children[i]],pipelineLayout);
-        }
+        const IrMeshCacheHeader &header = *meshCache.header;
+        vertexBuffer.uploadData(uploadBatch, meshCache.section<uint8_t>(header.vertices), header.vertices.size);
+        positionBuffer.uploadData(uploadBatch, meshCache.section<uint8_t>(header.positions), header.positions.size);
+        indexBuffer.uploadData(uploadBatch, meshCache.section<uint8_t>(header.indices), header.indices.size);
+    }
+    else
+    {
+        vertexBuffer.uploadData(uploadBatch, packedVertices);
+        positionBuffer.uploadData(uploadBatch, positions);
+        indexBuffer.uploadData(uploadBatch, indices);
     }
 }
 
@@ -625,9 +1220,25 @@ void Render::mainLoop()
         drawFrame();
     }
 
+    waitForLoaderJobs();
     vkDeviceWaitIdle(device);
 }
 
+// The import and cooking jobs write into the scene, so they finish before it is torn down. Rethrows the first error
+// once all of them have finished.
+void Render::waitForLoaderJobs()
+{
+    std::vector<IrJobHandle> jobs;
+    for (const IrJobHandle &job : {sceneLoaded, imagesDecoded, modelCooked})
+    {
+        if (job)
+        {
+            jobs.push_back(job);
+        }
+    }
+    jobSystem->wait(jobs);
+}
+
 VkResult Render::CreateDebugUtilsMessengerEXT(VkInstance instance,
                                               const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo,
                                               const VkAllocationCallbacks *pAllocator,
@@ -668,9 +1279,80 @@ void Render::createDescriptorSet()
 
 }
 
+void Render::createDrawList()
+{
+    if (meshCache.isOpen())
+    {
+        const IrMeshCacheHeader &header = *meshCache.header;
+        drawList.loadCookedDrawList(meshCache.section<IrCookedDraw>(header.draws),
+                                    meshCache.section<IrDrawBounds>(header.drawBounds), header.drawCount);
+    }
+    else
+    {
+        drawList.buildDrawList(primitiveChunks);
+        drawList.computeBounds(positions, indices);
+    }
+
+    if (cpuOcclusionCulling || cpuShadowOcclusionCulling)
+    {
+        std::vector<IrOcclusionMesh> meshes;
+        for (size_t i = 0; i < drawList.items.size(); i++)
+        {
+            const IrDrawItem &item = drawList.items[i];
+            meshes.push_back({item.firstIndex, item.indexCount, item.vertexOffset,
+                              glm::vec3(drawList.bounds[i].aabbMin), glm::vec3(drawList.bounds[i].aabbMax)});
+        }
+        cpuShadowOcclusion.setMeshes(meshes);
+        cpuOcclusion.setMeshes(std::move(meshes));
+    }
+}
+
+void Render::createIndirectDraws()
+{
+    if (!indirectDraw)
+    {
+        return;
+    }
+
+    indirectDraws.createIndirectDraws(drawList, uploadBatch);
+
+    std::vector<VkDescriptorImageInfo> textureImageInfos;
+    for (auto &texture : irTextures)
+    {
+        textureImageInfos.push_back(texture.descriptorSetImageInfo);
+    }
+    // The array always has at least one element, and every element must be written before the set is bound.
+    if (textureImageInfos.empty())
+    {
+        textureImageInfos.push_back(placeholderTexture.descriptorSetImageInfo);
+    }
+    indirectDescriptor.createIndirectDescriptorSet(textureImageInfos, indirectDraws.materialBufferInfo);
+
+    if (gpuCulling)
+    {
+        cullPass.createCullPass(uploadBatch, drawList, indirectDraws, occlusionCulling ? &depthPyramid : nullptr,
+                                clusterCulling ? &meshlets : nullptr);
+    }
+}
+
+void Render::createDepthPyramid()
+{
+    if (!occlusionCulling)
+    {
+        return;
+    }
+
+    depthPyramid.createReduceSampler();
+    depthPyramid.createDepthPyramid(swapchain.depthImage, swapchain.swapChainExtent);
+}
+
 void Render::createRenderPass()
 {
     renderpass.createRenderPass(swapchain.swapChainImageFormat);
+    if (occlusionCulling)
+    {
+        renderpass.createOcclusionRenderPasses(swapchain.swapChainImageFormat);
+    }
     offscreen.renderpass.createRenderPass();
 }
 void Render::createFrameBuffer()
@@ -686,6 +1368,23 @@ void Render::createPipeLine()
     debugpass.pipeline.createGraphicsPipeline(renderpass.renderPass,debugpass.debugDescriptor
     );
     shadowRenderPipeline.createGraphicsPipeline(renderpass.renderPass, shadowRenderDescriptor);
+    if (indirectDraw)
+    {
+        shadowRenderPipeline.createIndirectGraphicsPipeline(renderpass.renderPass, shadowRenderDescriptor,
+                                                            indirectDescriptor);
+    }
+    if (gpuCulling)
+    {
+        cullPass.pipeline.createComputePipeline(cullPass.cullDescriptor, occlusionCulling);
+    }
+    if (clusterCulling)
+    {
+        cullPass.clusterPipeline.createComputePipeline(cullPass.cullDescriptor, occlusionCulling);
+    }
+    if (occlusionCulling)
+    {
+        depthPyramid.pipeline.createComputePipeline(depthPyramid.depthReduceDescriptor);
+    }
 }
 
 void Render::createOffscreenResource()
@@ -698,32 +1397,52 @@ void Render::createDescriptorSetLayout()
     shadowRenderDescriptor.createShadowRenderDescriptorSetLayouts();
     offscreen.shadowDescriptor.createShadowDescriptorSetLayouts();
     debugpass.debugDescriptor.createDebugDescriptorSetLayouts();
+    if (indirectDraw)
+    {
+        indirectDescriptor.createIndirectDescriptorSetLayouts(static_cast<uint32_t>(irTextures.size()));
+    }
+    if (gpuCulling)
+    {
+        cullPass.cullDescriptor.createCullDescriptorSetLayouts(occlusionCulling, clusterCulling);
+    }
+    if (occlusionCulling)
+    {
+        depthPyramid.depthReduceDescriptor.createDepthReduceDescriptorSetLayouts();
+    }
 }
 
 void Render::initVulkan()
 {
+    // A valid cooked cache replaces the glTF import. Otherwise parsing the glTF, flattening its meshes and decoding
+    // its images run as jobs; either way the scene is created from drawFrame once it is ready, see streamAssets.
+    if (!useMeshCache || !meshCache.open(modePath, *jobSystem))
+    {
+        IrJobHandle parsed = jobSystem->schedule([]() { loadGltf(modePath); });
+        sceneLoaded = jobSystem->schedule(
+            [this]() {
+                loadScene(vertices, indices, primitiveChunks, meshlets, *jobSystem);
+                packVertices();
+            },
+            {parsed});
+        imagesDecoded = jobSystem->schedule([this]() { decodeImages(*jobSystem); }, {parsed});
+    }
+
     createInstance();
     setupDebugMessenger();
     createSurface();
     pickPhysicalDevice(instance, surface);
     createLogicalDevice(surface);
     createAllocator(instance);
+    stagingRing.createStagingRing(stagingRingSize);
     createSampler();
     swapchain.createSwapChain(surface, window, renderpass.renderPass);
     createRenderPass();
     createFrameBuffer();
     createCommandPool(surface);
-    loadModel(modePath, vertices, indices, firstIndex, firstIndexs);
-    loadImages(irTextures);
-    createDescriptorSetLayout();
-    createUniformBuffer();
-    createVertexBuffer();
-    createIndexBuffer();
-    cpyBuffer();
-    createDescriptorPool(irTextures.size());
-    createOffscreenResource();
-    createDescriptorSet();
-    createPipeLine();
-    createCommandBuffer();
+    uploadBatch.createUploadBatch();
+    const uint8_t grey[4] = {128, 128, 128, 255};
+    placeholderTexture.createTextureByBuffer(uploadBatch, grey, 1, 1);
+    uploadBatch.submit();
+    createCommandBuffers();
     createSyncObjects();
-}
\ No newline at end of file
+}